@@ -0,0 +1,232 @@
+/**************************************************************************
+ * C S 429 MM-lab
+ *
+ * capture.c - An LD_PRELOAD shim that records every malloc, free, realloc
+ * and calloc call of a program, with its thread and time, into a capture
+ * that read_trace and convert_trace turn into a trace:
+ *
+ *     LD_PRELOAD=./capture.so program args...
+ *     ./convert_trace -t umalloc.capture.<pid> program.rep
+ *
+ * Each thread buffers its records and writes them out a buffer at a time
+ * with a single write to a file opened for appending, so threads never
+ * wait for each other. The file is named by UMCAPTURE_FILE, or
+ * umalloc.capture, followed by the process id, so programs the captured
+ * one runs write captures of their own. A thread's last records are
+ * written when it exits, and the main thread's at exit; threads still
+ * running then lose theirs. Children forked without an exec are not
+ * captured.
+ **************************************************************************/
+
+#define _GNU_SOURCE /* RTLD_NEXT */
+#include "support.h"
+#include <dlfcn.h>
+#include <sys/syscall.h>
+
+#define CAPTURE_BUFFER 4096 /* records a thread buffers before writing them out */
+#define BOOTSTRAP_BYTES (64 * 1024) /* served to dlsym while the real functions are looked up */
+
+#define THREAD_LOCAL __thread __attribute__((tls_model("initial-exec")))
+
+static void *(*real_malloc)(size_t);
+static void (*real_free)(void *);
+static void *(*real_realloc)(void *, size_t);
+static void *(*real_calloc)(size_t, size_t);
+
+static int capture_fd = -1;
+static pthread_key_t flush_key;
+static _Alignas(16) char bootstrap[BOOTSTRAP_BYTES];
+static size_t bootstrap_used = 0;
+static bool resolving = false;
+
+static THREAD_LOCAL capture_record_t *buffer = NULL;
+static THREAD_LOCAL int buffered = 0;
+static THREAD_LOCAL uint32_t thread_id = 0;
+static THREAD_LOCAL bool busy = false; /* inside the shim, whose own calls go unrecorded */
+
+/*
+ * bootstrap_alloc - hands out memory for the calls dlsym makes before the
+ * real functions are known. It is never given back.
+ */
+static void *bootstrap_alloc(size_t size) {
+    size_t start = (bootstrap_used + 15) & ~(size_t) 15;
+    if (start + size > BOOTSTRAP_BYTES) {
+        return NULL;
+    }
+    bootstrap_used = start + size;
+    return bootstrap + start;
+}
+
+static bool in_bootstrap(void *ptr) {
+    return (char *) ptr >= bootstrap && (char *) ptr < bootstrap + BOOTSTRAP_BYTES;
+}
+
+/*
+ * flush - writes out the records buffer holds, in one piece.
+ */
+static void flush(capture_record_t *records, int count) {
+    size_t bytes = count * sizeof(capture_record_t);
+    if (capture_fd >= 0 && write(capture_fd, records, bytes) != (ssize_t) bytes) {
+        close(capture_fd);
+        capture_fd = -1;
+    }
+}
+
+/*
+ * flush_thread - writes out an exiting thread's last records and unmaps its
+ * buffer.
+ */
+static void flush_thread(void *records) {
+    flush(records, buffered);
+    buffered = 0;
+    buffer = NULL;
+    munmap(records, CAPTURE_BUFFER * sizeof(capture_record_t));
+}
+
+/*
+ * stop_in_child - a forked child shares the parent's file and pointers, so
+ * it records nothing.
+ */
+static void stop_in_child(void) {
+    capture_fd = -1;
+    buffered = 0;
+}
+
+/*
+ * capture_init - looks up the real functions and opens the capture. Runs
+ * before main, or on the first call if another library allocates earlier.
+ */
+__attribute__((constructor)) static void capture_init(void) {
+    if (real_malloc != NULL || resolving) {
+        return;
+    }
+    resolving = true;
+    real_malloc = dlsym(RTLD_NEXT, "malloc");
+    real_free = dlsym(RTLD_NEXT, "free");
+    real_realloc = dlsym(RTLD_NEXT, "realloc");
+    real_calloc = dlsym(RTLD_NEXT, "calloc");
+    resolving = false;
+
+    busy = true;
+    char name[MAXLINE];
+    const char *prefix = getenv("UMCAPTURE_FILE");
+    snprintf(name, sizeof(name), "%s.%d", (prefix != NULL) ? prefix : "umalloc.capture", (int) getpid());
+    capture_fd = open(name, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (capture_fd >= 0) {
+        capture_header_t header = {.record_size = sizeof(capture_record_t), .reserved = 0};
+        memcpy(header.magic, CAPTURE_MAGIC, sizeof(header.magic));
+        if (write(capture_fd, &header, sizeof(header)) != sizeof(header)) {
+            close(capture_fd);
+            capture_fd = -1;
+        }
+    }
+    if (capture_fd >= 0) {
+        pthread_key_create(&flush_key, flush_thread);
+        pthread_atfork(NULL, NULL, stop_in_child);
+    }
+    busy = false;
+}
+
+/*
+ * capture_fini - writes out the main thread's last records at exit.
+ */
+__attribute__((destructor)) static void capture_fini(void) {
+    if (buffer != NULL) {
+        flush(buffer, buffered);
+        buffered = 0;
+    }
+}
+
+/*
+ * now - returns CLOCK_MONOTONIC in ns.
+ */
+static uint64_t now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000000000UL + time.tv_nsec;
+}
+
+/*
+ * record - buffers the record of a call made at time, writing the buffer out
+ * when it is full. Calls the shim makes itself, and calls after the capture
+ * failed, are not recorded.
+ */
+static void record(uint32_t op, void *ptr, void *old, size_t size, uint64_t time) {
+    if (capture_fd < 0 || busy) {
+        return;
+    }
+    busy = true;
+    if (buffer == NULL) {
+        void *records = mmap(NULL, CAPTURE_BUFFER * sizeof(capture_record_t), PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (records == MAP_FAILED) {
+            busy = false;
+            return;
+        }
+        buffer = records;
+        thread_id = syscall(SYS_gettid);
+        pthread_setspecific(flush_key, buffer);
+    }
+
+    buffer[buffered++] = (capture_record_t) {.time = time, .ptr = (uintptr_t) ptr, .old = (uintptr_t) old,
+                                             .size = size, .thread = thread_id, .op = op};
+    if (buffered == CAPTURE_BUFFER) {
+        flush(buffer, buffered);
+        buffered = 0;
+    }
+    busy = false;
+}
+
+void *malloc(size_t size) {
+    if (real_malloc == NULL) {
+        capture_init();
+        if (real_malloc == NULL) {
+            return bootstrap_alloc(size);
+        }
+    }
+    void *ptr = real_malloc(size);
+    record(CAPTURE_MALLOC, ptr, NULL, size, now());
+    return ptr;
+}
+
+void free(void *ptr) {
+    if (ptr == NULL || in_bootstrap(ptr) || real_free == NULL) {
+        return;
+    }
+    /* Timed before the block can be handed out again, so replays free it first */
+    uint64_t time = now();
+    real_free(ptr);
+    record(CAPTURE_FREE, ptr, NULL, 0, time);
+}
+
+void *realloc(void *old, size_t size) {
+    if (real_realloc == NULL || in_bootstrap(old)) {
+        void *ptr = malloc(size);
+        if (ptr != NULL && old != NULL) {
+            /* bootstrap blocks are never bigger than what is left of the arena */
+            size_t left = bootstrap + BOOTSTRAP_BYTES - (char *) old;
+            memcpy(ptr, old, (size < left) ? size : left);
+        }
+        return ptr;
+    }
+    void *ptr = real_realloc(old, size);
+    record(CAPTURE_REALLOC, ptr, old, size, now());
+    return ptr;
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    size_t bytes;
+    if (__builtin_mul_overflow(nmemb, size, &bytes)) {
+        bytes = SIZE_MAX;
+    }
+    if (real_calloc == NULL) {
+        capture_init();
+        if (real_calloc == NULL) {
+            /* the arena is zero until handed out */
+            return (bytes == SIZE_MAX) ? NULL : bootstrap_alloc(bytes);
+        }
+    }
+    void *ptr = real_calloc(nmemb, size);
+    record(CAPTURE_CALLOC, ptr, NULL, bytes, now());
+    return ptr;
+}
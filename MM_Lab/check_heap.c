@@ -1,28 +1,386 @@
 #include "check_heap.h"
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define SAMPLE_BLOCKS 4 /* listed blocks check_heap_sample looks at besides the bin heads */
+#define SAMPLE_DEPTH 16 /* furthest into its bin a sampled block can lie */
 
-extern mem_block_header_t *free_head;
 extern mem_block_header_t *free_heads[BIN_COUNT];
+extern uint64_t bin_bitmap[BITMAP_WORDS];
+extern tree_node_t *free_tree;
+extern heap_region_t *heap_regions;
+extern size_t region_count;
 
-int check_heap()
+/* A free block found by check_heap_walk and the number of lists it is on */
+typedef struct
 {
-    for (int i = 0; i < BIN_COUNT; ++i)
+    mem_block_header_t *block;
+    size_t lists;
+} walked_t;
+
+static walked_t *walked = NULL; /* mapped, so checking never moves the break */
+static size_t walked_capacity = 0;
+static uint64_t sample_state = 0x9E3779B97F4A7C15UL; /* kept apart from rand() so checks leave traces alone */
+
+/*
+ * report - prints a violation found at addr after trace line line (0 if the
+ * check is not tied to a line) and returns HEAP_FAILURE.
+ */
+static int report(long line, void *addr, const char *what)
+{
+    if (line > 0)
+        printf("line %ld: ", line);
+    printf("check_heap: %s at %p.\n", what, addr);
+    return HEAP_FAILURE;
+}
+
+/*
+ * sample - returns a pseudo-random number below bound (xorshift64).
+ */
+static size_t sample(size_t bound)
+{
+    sample_state ^= sample_state << 13;
+    sample_state ^= sample_state >> 7;
+    sample_state ^= sample_state << 17;
+    return sample_state % bound;
+}
+
+/*
+ * region_of - returns the region block lies in, or NULL if it is not in the
+ * heap. Regions are made in address order, so this is a binary search.
+ */
+static heap_region_t *region_of(mem_block_header_t *block)
+{
+    size_t low = 0, high = region_count;
+
+    while (low < high)
     {
-        int result = check_bin(free_heads[i]);
-        if (result)
-            return result;
+        size_t mid = low + (high - low) / 2;
+        if (block < heap_regions[mid].first)
+            high = mid;
+        else if (block >= heap_regions[mid].epilogue)
+            low = mid + 1;
+        else
+            return &heap_regions[mid];
     }
+    return NULL;
+}
+
+/*
+ * check_boundary_tags - checks that a listed free block has a matching
+ * footer, was fully coalesced and is flagged in the block after it.
+ */
+static int check_boundary_tags(mem_block_header_t *block)
+{
+    size_t size = get_size(block);
+    mem_block_header_t *next = (mem_block_header_t *)((char *)block + size);
+
+    if (size < MIN_BLOCK_SIZE || *(size_t *)((char *)next - sizeof(size_t)) != size)
+        return HEAP_FAILURE;
+
+    if ((block->block_metadata & PREV_FREE) || !is_allocated(next) || !(next->block_metadata & PREV_FREE))
+        return HEAP_FAILURE;
+
     return HEAP_SUCCESS;
 }
 
+/*
+ * check_tree - checks the subtree under node, visited in order: parent
+ * links, size then address order after *last, free blocks of at least
+ * TREE_MIN_SIZE, no red node with a red child and the same number of black
+ * nodes on every path. Adds the nodes to *count and returns the subtree's
+ * black height, or -1 if anything is wrong.
+ */
+static int check_tree(tree_node_t *node, tree_node_t *parent, mem_block_header_t **last, size_t *count)
+{
+    if (node == NULL)
+        return 0;
+
+    mem_block_header_t *block = (mem_block_header_t *)node - 1;
+    if (node->parent != parent || (parent != NULL && parent->red && node->red))
+        return -1;
+
+    int left = check_tree(node->left, node, last, count);
+    if (left < 0 || is_allocated(block) || get_size(block) < TREE_MIN_SIZE)
+        return -1;
+    if (*last != NULL && (get_size(*last) > get_size(block) || (get_size(*last) == get_size(block) && *last >= block)))
+        return -1;
+    *last = block;
+    (*count)++;
+
+    int right = check_tree(node->right, node, last, count);
+    if (right != left)
+        return -1;
+    return left + !node->red;
+}
+
+/*
+ * check_listed - checks a block found on bin after prev without trusting
+ * anything but the region table: it must lie in the heap with its whole
+ * size, be free, belong to the bin and link back to prev. Its boundary tags
+ * are checked too if tags is set. Reports every violation.
+ */
+static int check_listed(mem_block_header_t *block, int bin, mem_block_header_t *prev, bool tags, long line)
+{
+    heap_region_t *region = region_of(block);
+
+    if (region == NULL || (uintptr_t)get_payload(block) % ALIGNMENT != 0)
+        return report(line, block, "listed block is not in the heap");
+    if ((char *)block + get_size(block) > (char *)region->epilogue)
+        return report(line, block, "listed block runs past the end of its region");
+    if (is_allocated(block))
+        return report(line, block, "listed block is allocated");
+
+    int result = HEAP_SUCCESS;
+    if (size_class(get_size(block)) != bin)
+        result = report(line, block, "listed block is in the wrong bin");
+    if (block->prev != prev)
+        result = report(line, block, "listed block's prev link does not point back");
+    if (tags && check_boundary_tags(block))
+        result = report(line, block, "listed block's boundary tags are broken");
+    return result;
+}
+
+/*
+ * check_heap_sample - a check cheap enough for every op: whatever the size
+ * of the heap, it looks at the head of every bin and its successor, the
+ * bitmap, the root of free_tree and SAMPLE_BLOCKS blocks a random distance
+ * into random non-empty bins, with their boundary tags. Reports every
+ * violation it sees against trace line line.
+ */
+int check_heap_sample(long line)
+{
+    int result = HEAP_SUCCESS;
+
+    for (int i = 0; i < BIN_COUNT; ++i)
+    {
+        mem_block_header_t *head = free_heads[i];
+        bool marked = (bin_bitmap[i / 64] >> (i % 64)) & 1;
+
+        if (marked != (head != NULL))
+            result = report(line, &free_heads[i], "bitmap disagrees with its bin");
+        if (head == NULL)
+            continue;
+        if (check_listed(head, i, NULL, true, line))
+        {
+            result = HEAP_FAILURE;
+            continue;
+        }
+        if (head->next != NULL && check_listed(head->next, i, head, false, line))
+            result = HEAP_FAILURE;
+    }
+
+    if (free_tree != NULL)
+    {
+        mem_block_header_t *root = (mem_block_header_t *)free_tree - 1;
+        if (free_tree->red || free_tree->parent != NULL || region_of(root) == NULL || is_allocated(root) ||
+            get_size(root) < TREE_MIN_SIZE)
+            result = report(line, root, "free_tree's root is not a large free block");
+    }
+
+    for (int i = 0; i < SAMPLE_BLOCKS && result == HEAP_SUCCESS; ++i)
+    {
+        int bin = sample(BIN_COUNT);
+        for (int tried = 0; tried < BIN_COUNT && free_heads[bin] == NULL; ++tried)
+            bin = (bin + 1) % BIN_COUNT;
+        if (free_heads[bin] == NULL)
+            break;
+
+        /* The heads checked out, so each step below follows a checked link */
+        mem_block_header_t *prev = NULL, *block = free_heads[bin];
+        for (size_t steps = sample(SAMPLE_DEPTH); steps > 0 && block->next != NULL; --steps)
+        {
+            prev = block;
+            block = block->next;
+            if (check_listed(block, bin, prev, false, line))
+                return HEAP_FAILURE;
+        }
+        result = check_listed(block, bin, prev, true, line);
+    }
+    return result;
+}
+
+/*
+ * compare_walked - orders walked blocks by address.
+ */
+static int compare_walked(const void *a, const void *b)
+{
+    mem_block_header_t *x = ((const walked_t *)a)->block, *y = ((const walked_t *)b)->block;
+    return (x > y) - (x < y);
+}
+
+/*
+ * find_walked - returns the walked entry for block, or NULL if the walk did
+ * not find a free block there.
+ */
+static walked_t *find_walked(mem_block_header_t *block, size_t count)
+{
+    walked_t key = {block, 0};
+    return bsearch(&key, walked, count, sizeof(walked_t), compare_walked);
+}
+
+/*
+ * record_walked - adds a free block to the walked entries, doubling their
+ * mapping when it is full. Returns the new count.
+ */
+static size_t record_walked(mem_block_header_t *block, size_t count)
+{
+    if (count == walked_capacity)
+    {
+        size_t capacity = (walked_capacity == 0) ? 4096 : 2 * walked_capacity;
+        walked_t *grown = mmap(NULL, capacity * sizeof(walked_t), PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (grown == MAP_FAILED)
+        {
+            fprintf(stderr, "check_heap: out of memory for the heap walk\n");
+            exit(1);
+        }
+        if (walked != NULL)
+        {
+            memcpy(grown, walked, count * sizeof(walked_t));
+            munmap(walked, walked_capacity * sizeof(walked_t));
+        }
+        walked = grown;
+        walked_capacity = capacity;
+    }
+    walked[count].block = block;
+    walked[count].lists = 0;
+    return count + 1;
+}
+
+/*
+ * walk_region - walks a region block by block by their sizes, from its first
+ * block up to its epilogue, checking each block's size, alignment and
+ * PREV_FREE flag, and the footer and coalescing of each free block, which it
+ * records. A block whose size does not lead to another ends the walk of the
+ * region. Reports every violation and returns the new count of free blocks.
+ */
+static size_t walk_region(heap_region_t *region, size_t count, int *result, long line)
+{
+    mem_block_header_t *block = region->first;
+    bool prev_free = false;
+
+    while (block < region->epilogue)
+    {
+        size_t size = get_size(block);
+
+        if ((uintptr_t)get_payload(block) % ALIGNMENT != 0 || size < MIN_BLOCK_SIZE || size % ALIGNMENT != 0 ||
+            (char *)block + size > (char *)region->epilogue)
+        {
+            *result = report(line, block, "block's size does not lead to the next block");
+            return count;
+        }
+        if (block->block_metadata & MMAP_BIT)
+            *result = report(line, block, "heap block is marked as a mapping");
+        if (((block->block_metadata & PREV_FREE) != 0) != prev_free)
+            *result = report(line, block, "PREV_FREE disagrees with the block before");
+
+        if (!is_allocated(block))
+        {
+            if (prev_free)
+                *result = report(line, block, "free block was not coalesced with the one before");
+            if (*(size_t *)((char *)block + size - sizeof(size_t)) != size)
+                *result = report(line, block, "free block's footer does not match its header");
+            count = record_walked(block, count);
+        }
+        prev_free = !is_allocated(block);
+        block = (mem_block_header_t *)((char *)block + size);
+    }
+
+    if (block != region->epilogue || get_size(block) != 0 || !is_allocated(block))
+        *result = report(line, region->epilogue, "region does not end in its epilogue");
+    else if (((block->block_metadata & PREV_FREE) != 0) != prev_free)
+        *result = report(line, block, "PREV_FREE disagrees with the block before");
+    return count;
+}
+
+/*
+ * check_heap_walk - checks the whole heap in time linear in its blocks
+ * (besides a lookup per listed block): walks every region by physical
+ * adjacency, then follows every bin and checks that each listed block is a
+ * free block the walk found, in the right bin and on no other list, and
+ * that every free block the walk found is listed. free_tree must be a valid
+ * red-black tree of exactly the listed blocks of at least TREE_MIN_SIZE
+ * bytes. Unlike check_heap_sample it goes on past a violation and reports
+ * every one it finds against trace line line.
+ */
+int check_heap_walk(long line)
+{
+    int result = HEAP_SUCCESS;
+    size_t count = 0, listed = 0, in_tree = 0;
+    bool sorted = true;
+
+    for (size_t i = 0; i < region_count; ++i)
+    {
+        if (i > 0 && heap_regions[i].first < heap_regions[i - 1].epilogue)
+            sorted = false;
+        count = walk_region(&heap_regions[i], count, &result, line);
+    }
+    if (!sorted)
+        qsort(walked, count, sizeof(walked_t), compare_walked);
+
+    for (int i = 0; i < BIN_COUNT; ++i)
+    {
+        bool marked = (bin_bitmap[i / 64] >> (i % 64)) & 1;
+        if (marked != (free_heads[i] != NULL))
+            result = report(line, &free_heads[i], "bitmap disagrees with its bin");
+
+        mem_block_header_t *prev = NULL;
+        for (mem_block_header_t *block = free_heads[i]; block != NULL; block = block->next)
+        {
+            /* Only blocks the walk vouches for are followed, which also ends any cycle */
+            walked_t *entry = find_walked(block, count);
+            if (entry == NULL)
+            {
+                result = report(line, block, "listed block is not a free block of the heap");
+                break;
+            }
+            if (entry->lists++ != 0)
+            {
+                result = report(line, block, "free block is listed more than once");
+                break;
+            }
+            if (size_class(get_size(block)) != i)
+                result = report(line, block, "listed block is in the wrong bin");
+            if (block->prev != prev)
+                result = report(line, block, "listed block's prev link does not point back");
+            listed += (get_size(block) >= TREE_MIN_SIZE);
+            prev = block;
+        }
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (walked[i].lists == 0)
+            result = report(line, walked[i].block, "free block is not on any list");
+    }
+
+    mem_block_header_t *last = NULL;
+    if ((free_tree != NULL && free_tree->red) || check_tree(free_tree, NULL, &last, &in_tree) < 0)
+        result = report(line, free_tree, "free_tree is not a valid tree of large free blocks");
+    else if (listed != in_tree)
+        result = report(line, free_tree, "free_tree does not hold exactly the large listed blocks");
+    return result;
+}
+
+/*
+ * check_heap - checks the whole heap with check_heap_walk, outside of any
+ * trace line.
+ */
+int check_heap()
+{
+    return check_heap_walk(0);
+}
+
 /*
  * STUDENT TODO: set these variables according to your heap design (tests will fail if you do not
  * set these variables!)
  *    - order:      how is your free list ordered?
  *    - circular:   true if your free list is circular; false otherwise
  */
-heap_order order = ORD_MEM;
+heap_order order = ORD_RAND;
 bool circular = false;
 
 /*
@@ -39,42 +397,44 @@ bool circular = false;
  *
  *      - Ensure that all blocks on the free list are free (no implicit free lists)
  *
+ * Bins are LIFO doubly linked lists, so every block's prev must point back at
+ * the block before it. Alignment, which applies to payloads rather than
+ * headers, is checked before a block is dereferenced.
+ *
  * Should return HEAP_SUCCESS if the heap is consistent or HEAP_FAILURE if an error
  * is detected.
  */
 int check_bin(mem_block_header_t *free_head)
 {
+    mem_block_header_t *prev = NULL;
 
-    while (free_head->next != NULL)
+    for (mem_block_header_t *block = free_head; block != NULL; block = block->next)
     {
-
-        if (free_head > free_head->next)
+        if ((uintptr_t)get_payload(block) % ALIGNMENT != 0)
         {
             return HEAP_FAILURE;
         }
 
-        if ((free_head->block_metadata & 1) == 1)
+        if (is_allocated(block))
         {
             return HEAP_FAILURE;
         }
 
-        mem_block_header_t *new_ptr = (free_head + 1);
-        new_ptr = (mem_block_header_t *)((char *)new_ptr + (free_head->block_metadata >> 1));
-        if (((uintptr_t)free_head->next > (uintptr_t)free_head) && ((uintptr_t)free_head->next < (uintptr_t)(new_ptr)))
+        if (get_size(block) % ALIGNMENT != 0 || block->prev != prev)
         {
             return HEAP_FAILURE;
         }
 
-        if ((uintptr_t)free_head % 16 != 0)
+        if (prev != NULL)
         {
-            return HEAP_FAILURE;
+            uintptr_t prev_start = (uintptr_t)prev, prev_end = prev_start + get_size(prev);
+            uintptr_t start = (uintptr_t)block, end = start + get_size(block);
+            if (start < prev_end && prev_start < end)
+            {
+                return HEAP_FAILURE;
+            }
         }
-        free_head = free_head->next;
-    }
-
-    if (((uintptr_t)free_head % 16) != 0)
-    {
-        return HEAP_FAILURE;
+        prev = block;
     }
 
     return HEAP_SUCCESS;
@@ -1,6 +1,8 @@
 #include "umalloc.h"
 int check_heap();
-int check_bin();
+int check_heap_sample(long line);
+int check_heap_walk(long line);
+int check_bin(mem_block_header_t *free_head);
 
 typedef enum {
     HEAP_SUCCESS,
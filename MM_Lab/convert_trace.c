@@ -0,0 +1,50 @@
+/**************************************************************************
+ * C S 429 MM-lab
+ *
+ * convert_trace.c - Converts a trace between the text .rep format and the
+ * binary format read_trace maps without parsing, or a capture of a real
+ * program's calls (see capture.c) into either.
+ **************************************************************************/
+
+#include "support.h"
+
+static void usage(void) {
+    fprintf(stderr, "Usage: convert_trace [-t] [-T thread] in out\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-t         Write a text .rep trace (default: binary).\n");
+    fprintf(stderr, "\t-T <tid>   Keep only the calls of this thread of a capture.\n");
+    fprintf(stderr, "The input may be in either format, or a capture from capture.so.\n");
+}
+
+int main(int argc, char **argv) {
+    int binary = 1;
+    long thread = -1;
+    char c;
+
+    while ((c = getopt(argc, argv, "thT:")) != EOF) {
+        switch (c) {
+        case 't':
+            binary = 0;
+            break;
+        case 'T':
+            thread = strtol(optarg, NULL, 0);
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+
+    if (argc - optind != 2) {
+        usage();
+        appl_error("Expected an input and an output file.");
+    }
+
+    trace_t *trace = (thread >= 0) ? read_capture(argv[optind], thread) : read_trace(argv[optind], 0);
+    write_trace(trace, argv[optind + 1], binary);
+    free_trace(trace);
+    return 0;
+}
@@ -0,0 +1,188 @@
+/**************************************************************************
+ * C S 429 MM-lab
+ *
+ * event_report.c - Summarizes the events a tracing build of umalloc wrote
+ * (make tracing): the probe lengths of the allocations in each size class,
+ * how often they had to extend the heap or split a block, and what they
+ * cost.
+ **************************************************************************/
+
+#include "umalloc.h"
+#include "support.h"
+
+#define PROBE_LIMIT 1024 /* probe counts of PROBE_LIMIT - 1 or more share the last slot */
+#define CHUNK_EVENTS 4096 /* events read at a time */
+
+/* The allocations of one size class, with an exact histogram of their probes. */
+typedef struct {
+    uint64_t probes[PROBE_LIMIT];
+    uint64_t count;
+    uint64_t total_probes;
+    uint64_t max_probes;
+    uint64_t extends;
+    uint64_t splits;
+    uint64_t cached;
+    uint64_t cycles;
+} class_report_t;
+
+extern char msg[MAXLINE];
+
+static const char *op_names[UEVENT_OPS] = {"malloc", "free", "realloc", "calloc", "aligned", "dropped"};
+static uint64_t op_counts[UEVENT_OPS];
+static uint64_t op_cycles[UEVENT_OPS];
+static uint64_t dropped;
+static uint64_t first_start = UINT64_MAX, last_start;
+static bool threads[UINT16_MAX + 1];
+static uint32_t bin_count;
+static class_report_t *classes; /* bin_count classes, then all of them together */
+
+static void usage(void) {
+    fprintf(stderr, "Usage: event_report file...\n");
+    fprintf(stderr, "Reads the events a build with UMALLOC_TRACE wrote (make tracing) and prints\n");
+    fprintf(stderr, "CSV rows of the allocation count, probe lengths (mean, p50, p99, max),\n");
+    fprintf(stderr, "extends per 1000 allocations, splits and mean cycles per size class (all,\n");
+    fprintf(stderr, "then each class with allocations), after a summary of every call type.\n");
+}
+
+/*
+ * percentile - Returns the probe count at or below which a fraction q of the
+ * allocations in report fall.
+ */
+static uint64_t percentile(class_report_t *report, double q) {
+    uint64_t rank = (uint64_t) (q * report->count + 0.999999);
+    uint64_t seen = 0;
+    if (rank == 0) {
+        rank = 1;
+    }
+    for (int i = 0; i < PROBE_LIMIT; i++) {
+        seen += report->probes[i];
+        if (seen >= rank) {
+            return i;
+        }
+    }
+    return PROBE_LIMIT - 1;
+}
+
+static void record(class_report_t *report, uevent_t *event) {
+    report->probes[(event->probes < PROBE_LIMIT) ? event->probes : PROBE_LIMIT - 1]++;
+    report->count++;
+    report->total_probes += event->probes;
+    if (event->probes > report->max_probes) {
+        report->max_probes = event->probes;
+    }
+    report->extends += (event->flags & UEVENT_EXTEND) != 0;
+    report->splits += (event->flags & UEVENT_SPLIT) != 0;
+    report->cached += (event->flags & UEVENT_CACHED) != 0;
+    report->cycles += event->cycles;
+}
+
+/*
+ * add_event - Counts one event towards its call type and, for allocations,
+ * its size class.
+ */
+static void add_event(uevent_t *event) {
+    if (event->op >= UEVENT_OPS) {
+        appl_error("Event of an unknown type.");
+    }
+    if (event->op == UEVENT_DROPPED) {
+        dropped += event->size;
+        return;
+    }
+
+    op_counts[event->op]++;
+    op_cycles[event->op] += event->cycles;
+    threads[event->thread] = true;
+    if (event->start < first_start) {
+        first_start = event->start;
+    }
+    if (event->start > last_start) {
+        last_start = event->start;
+    }
+
+    if (event->op != UEVENT_FREE) {
+        if (event->class_id >= bin_count) {
+            appl_error("Event of an unknown size class.");
+        }
+        record(&classes[event->class_id], event);
+        record(&classes[bin_count], event);
+    }
+}
+
+/*
+ * read_events - Adds up every event in file, which must have been written by
+ * a build with the same number of size classes as the files before it.
+ */
+static void read_events(char *file) {
+    FILE *stream = fopen(file, "r");
+    if (stream == NULL) {
+        sprintf(msg, "Could not open %s in read_events", file);
+        appl_error(msg);
+    }
+
+    uevent_header_t header;
+    if (fread(&header, sizeof(header), 1, stream) != 1 ||
+        memcmp(header.magic, UEVENT_MAGIC, sizeof(header.magic)) != 0 || header.event_size != sizeof(uevent_t)) {
+        sprintf(msg, "%s is not an event file of this build", file);
+        appl_error(msg);
+    }
+    if (classes == NULL) {
+        bin_count = header.bin_count;
+        classes = calloc(bin_count + 1, sizeof(class_report_t));
+    } else if (header.bin_count != bin_count) {
+        sprintf(msg, "%s has %u size classes, not %u", file, header.bin_count, bin_count);
+        appl_error(msg);
+    }
+
+    static uevent_t events[CHUNK_EVENTS];
+    size_t count;
+    while ((count = fread(events, sizeof(uevent_t), CHUNK_EVENTS, stream)) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            add_event(&events[i]);
+        }
+    }
+    fclose(stream);
+}
+
+static void print_row(char *name, class_report_t *report) {
+    printf("%s,%lu,%.2f,%lu,%lu,%lu,%lu,%.2f,%lu,%lu,%.0f\n", name, report->count,
+           (double) report->total_probes / report->count, percentile(report, 0.5), percentile(report, 0.99),
+           report->max_probes, report->extends, 1000.0 * report->extends / report->count, report->splits,
+           report->cached, (double) report->cycles / report->count);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2 || strcmp(argv[1], "-h") == 0) {
+        usage();
+        exit(argc < 2);
+    }
+    for (int i = 1; i < argc; i++) {
+        read_events(argv[i]);
+    }
+
+    int thread_count = 0;
+    for (int i = 0; i <= UINT16_MAX; i++) {
+        thread_count += threads[i];
+    }
+    printf("# threads: %d, cycles from first to last call: %lu, events dropped: %lu\n", thread_count,
+           (first_start <= last_start) ? last_start - first_start : 0, dropped);
+    for (int op = 0; op < UEVENT_DROPPED; op++) {
+        if (op_counts[op] != 0) {
+            printf("# %s: %lu calls, %.0f cycles each\n", op_names[op], op_counts[op],
+                   (double) op_cycles[op] / op_counts[op]);
+        }
+    }
+
+    printf("class,allocs,mean_probes,p50_probes,p99_probes,max_probes,extends,extends_per_1k,splits,cached,"
+           "mean_cycles\n");
+    if (classes[bin_count].count != 0) {
+        print_row("all", &classes[bin_count]);
+    }
+    for (uint32_t i = 0; i < bin_count; i++) {
+        if (classes[i].count != 0) {
+            char name[16];
+            sprintf(name, "%u", i);
+            print_row(name, &classes[i]);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,187 @@
+/**************************************************************************
+ * C S 429 MM-lab
+ *
+ * gen_classes.c - Builds the size class table from a histogram of the
+ * request sizes in one or more traces and writes it to stdout as the
+ * size_classes.h header umalloc.c is compiled against.
+ **************************************************************************/
+
+#include "umalloc.h"
+#include "support.h"
+
+#define SLOTS (LARGE_CLASS_LIMIT / ALIGNMENT) /* lookup entries, one per ALIGNMENT bytes of block */
+#define MAX_CLASSES 256                         /* class ids are stored in a uint8_t */
+#define LOOKUP_PER_LINE 16
+
+static uint64_t histogram[SLOTS]; /* requests per block size / ALIGNMENT */
+static uint64_t total = 0;
+
+/*
+ * record - Counts count requests for a payload of size bytes, by the size of
+ * the block they are served from.
+ */
+static void record(size_t size, uint64_t count) {
+    size_t block_size = ALIGN(size + HEADER_SIZE);
+    if (block_size < MIN_BLOCK_SIZE) {
+        block_size = MIN_BLOCK_SIZE;
+    }
+    if (block_size < LARGE_CLASS_LIMIT) {
+        histogram[block_size / ALIGNMENT] += count;
+    }
+    total += count;
+}
+
+/*
+ * range_count - Returns the requests for block sizes in [lo, hi).
+ */
+static uint64_t range_count(size_t lo, size_t hi) {
+    uint64_t count = 0;
+    for (size_t size = lo; size < hi; size += ALIGNMENT) {
+        count += histogram[size / ALIGNMENT];
+    }
+    return count;
+}
+
+/*
+ * build_classes - Fills bounds with the smallest block size of every class
+ * and returns the number of classes. Block sizes below exact_limit get a
+ * class each. From there to LARGE_CLASS_LIMIT every power of two is split
+ * into 2^subclass_bits ranges; a range holding at least hot_share of the
+ * requests is cut into slices of 2^fine_bits per power of two, every slice
+ * that holds hot_share itself gets a class of its own and the cold slices
+ * between them are merged. Everything at or above LARGE_CLASS_LIMIT shares
+ * the last class.
+ */
+static int build_classes(size_t *bounds, size_t exact_limit, int subclass_bits, int fine_bits,
+                         double hot_share) {
+    int count = 0;
+    uint64_t hot = (uint64_t) (hot_share * total);
+    if (hot == 0) {
+        hot = 1;
+    }
+
+    for (size_t size = MIN_BLOCK_SIZE; size < exact_limit; size += ALIGNMENT) {
+        bounds[count++] = size;
+    }
+    for (size_t lo = exact_limit; lo < LARGE_CLASS_LIMIT; ) {
+        size_t power = 1UL << (63 - __builtin_clzl(lo));
+        size_t hi = lo + (power >> subclass_bits);
+        if (hi > 2 * power) {
+            hi = 2 * power;
+        }
+        bounds[count++] = lo;
+        if (range_count(lo, hi) >= hot) {
+            size_t slice = power >> fine_bits;
+            bool hot_last = range_count(lo, lo + slice) >= hot;
+            for (size_t start = lo + slice; start < hi; start += slice) {
+                bool hot_slice = range_count(start, start + slice) >= hot;
+                if (hot_slice || hot_last) {
+                    bounds[count++] = start;
+                }
+                hot_last = hot_slice;
+            }
+        }
+        lo = hi;
+    }
+    bounds[count++] = LARGE_CLASS_LIMIT;
+    return count;
+}
+
+/*
+ * write_header - Prints the generated header for the classes in bounds.
+ */
+static void write_header(size_t *bounds, int count, size_t exact_limit, int traces) {
+    printf("/*\n * size_classes.h - Generated by gen_classes from %lu requests in %d traces.\n", total, traces);
+    printf(" * Regenerate with make classes; do not edit.\n *\n");
+    printf(" * Class lower bounds (block size, header included):");
+    for (int i = 0; i < count; i++) {
+        printf("%s%lu", (i % 10 == 0) ? "\n *  " : " ", bounds[i]);
+    }
+    printf("\n */\n\n");
+    printf("#define EXACT_CLASS_LIMIT %luUL /* block sizes below this get one class each */\n", exact_limit);
+    printf("#define BIN_COUNT %d\n\n", count);
+
+    printf("/* SIZE_CLASS_LOOKUP[size / ALIGNMENT] is the class of blocks below LARGE_CLASS_LIMIT */\n");
+    printf("#define SIZE_CLASS_LOOKUP \\\n{");
+    int class_id = 0;
+    for (size_t slot = 0; slot < SLOTS; slot++) {
+        while (class_id + 1 < count && slot * ALIGNMENT >= bounds[class_id + 1]) {
+            class_id++;
+        }
+        if (slot % LOOKUP_PER_LINE == 0) {
+            printf(" \\\n    ");
+        }
+        printf("%d,", class_id);
+    }
+    printf(" \\\n}\n");
+}
+
+static void usage(void) {
+    fprintf(stderr, "Usage: gen_classes [-e bytes] [-s bits] [-f bits] [-p percent] file...\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-e <num>   Block sizes below this get one class each (default: 1024).\n");
+    fprintf(stderr, "\t-s <num>   Classes per power of two above that, as a power of two (default: 2).\n");
+    fprintf(stderr, "\t-f <num>   Finest split of a power of two for hot sizes, as a power of two (default: 5).\n");
+    fprintf(stderr, "\t-p <num>   Percent of requests that makes a size range hot (default: 1).\n");
+    fprintf(stderr, "Prints size_classes.h for the request sizes of every trace given.\n");
+}
+
+int main(int argc, char **argv) {
+    size_t exact_limit = 1024;
+    int subclass_bits = 2;
+    int fine_bits = 5;
+    double hot_percent = 1;
+    char c;
+
+    while ((c = getopt(argc, argv, "e:s:f:p:h")) != EOF) {
+        switch (c) {
+        case 'e':
+            exact_limit = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            subclass_bits = atoi(optarg);
+            break;
+        case 'f':
+            fine_bits = atoi(optarg);
+            break;
+        case 'p':
+            hot_percent = atof(optarg);
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+
+    if (exact_limit < MIN_BLOCK_SIZE || exact_limit % ALIGNMENT != 0 || exact_limit >= LARGE_CLASS_LIMIT
+        || (exact_limit & (exact_limit - 1)) != 0) {
+        appl_error("The exact class limit must be a power of two below LARGE_CLASS_LIMIT.");
+    }
+    if (subclass_bits < 0 || fine_bits < subclass_bits || (exact_limit >> fine_bits) < ALIGNMENT) {
+        appl_error("Subclass bits out of range.");
+    }
+
+    for (int i = optind; i < argc; i++) {
+        trace_t *trace = read_trace(argv[i], 0);
+        for (int op = 0; op < trace->num_ops; op++) {
+            traceop_t request = trace->ops[op];
+            if (request.type == ALLOC || request.type == REALLOC) {
+                record(request.size, 1);
+            } else if (request.type == BATCH_ALLOC) {
+                record(request.size, request.count);
+            }
+        }
+        free_trace(trace);
+    }
+
+    size_t bounds[SLOTS + 1];
+    int count = build_classes(bounds, exact_limit, subclass_bits, fine_bits, hot_percent / 100);
+    if (count > MAX_CLASSES) {
+        appl_error("Too many size classes.");
+    }
+    write_header(bounds, count, exact_limit, argc - optind);
+    return 0;
+}
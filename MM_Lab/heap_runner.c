@@ -64,9 +64,9 @@ void print_free_list() {
 
     mem_block_header_t* temp = test_blocks;
     do {
-        // address : size : allocation status : next
-        printf("      %p : 0x%lx : %lx : %p\n", 
-                temp, temp->block_metadata & ~0xF, temp->block_metadata & 0x1, temp->next);
+        // address : size : allocation status : prev : next
+        printf("      %p : 0x%lx : %lx : %p : %p\n", 
+                temp, temp->block_metadata & ~0xF, temp->block_metadata & 0x1, temp->prev, temp->next);
         temp = temp->next;
     } while (temp && (circular ? temp != test_blocks : 1));
     printf("\n");
@@ -158,9 +158,10 @@ size_t total_size() {
  */
 void build_free_list() {
     size_t total = total_size();
-    test_blocks = (mem_block_header_t*) malloc(total + 1024);
-    char* current = (char*) test_blocks;
-    char* boundary = (char*) test_blocks + total;
+    // Blocks start HEADER_SIZE bytes before an aligned payload.
+    char* current = (char*) malloc(total + 1024) + ALIGNMENT - HEADER_SIZE;
+    char* boundary = current + total;
+    test_blocks = (mem_block_header_t*) current;
     mem_block_header_t* last = NULL;
 
     switch (order) {
@@ -175,6 +176,7 @@ void build_free_list() {
                 } else {
                     block->next = NULL;
                 }
+                block->prev = last;
 
                 last = block;
             }
@@ -204,6 +206,7 @@ void build_free_list() {
                 } else {
                     block->next = NULL;
                 }
+                block->prev = last;
 
                 last = block;
             }
@@ -231,6 +234,7 @@ void build_free_list() {
                 } else {
                     block->next = NULL;
                 }
+                block->prev = last;
 
                 last = block;
             }
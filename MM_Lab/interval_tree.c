@@ -0,0 +1,377 @@
+/**************************************************************************
+ * C S 429 MM-lab
+ *
+ * interval_tree.c - A red-black tree of address ranges, augmented with the
+ * largest end in every subtree, for finding the ranges that overlap or
+ * neighbour another in O(log n).
+ **************************************************************************/
+
+#include "interval_tree.h"
+#include "support.h"
+
+#define SLAB_NODES 1024 /* nodes mapped at a time */
+
+/*
+ * max_end - returns the largest end under node, 0 for an empty subtree.
+ */
+static uintptr_t max_end(interval_t *node)
+{
+    return (node == NULL) ? 0 : node->max_end;
+}
+
+/*
+ * update - recomputes node's max_end from its own end and its children's.
+ */
+static void update(interval_t *node)
+{
+    uintptr_t end = node->end;
+
+    if (max_end(node->left) > end)
+    {
+        end = max_end(node->left);
+    }
+    if (max_end(node->right) > end)
+    {
+        end = max_end(node->right);
+    }
+    node->max_end = end;
+}
+
+/*
+ * before - returns true if the range of block id starting at start sorts
+ * before node.
+ */
+static bool before(uintptr_t start, int id, interval_t *node)
+{
+    return start < node->start || (start == node->start && id < node->id);
+}
+
+/*
+ * replace - puts node (which may be NULL) where old hangs from its parent.
+ */
+static void replace(interval_tree_t *tree, interval_t *old, interval_t *node)
+{
+    if (old->parent == NULL)
+    {
+        tree->root = node;
+    }
+    else if (old == old->parent->left)
+    {
+        old->parent->left = node;
+    }
+    else
+    {
+        old->parent->right = node;
+    }
+    if (node != NULL)
+    {
+        node->parent = old->parent;
+    }
+}
+
+/*
+ * rotate - rotates node down to the left, or to the right if left is false,
+ * lifting its child on the other side into its place. Only the two nodes'
+ * max_end change; the subtree as a whole keeps its ranges.
+ */
+static void rotate(interval_tree_t *tree, interval_t *node, bool left)
+{
+    interval_t *child = left ? node->right : node->left;
+    interval_t *inner = left ? child->left : child->right;
+
+    if (left)
+    {
+        node->right = inner;
+        child->left = node;
+    }
+    else
+    {
+        node->left = inner;
+        child->right = node;
+    }
+    if (inner != NULL)
+    {
+        inner->parent = node;
+    }
+    replace(tree, node, child);
+    node->parent = child;
+    child->max_end = node->max_end;
+    update(node);
+}
+
+/*
+ * new_node - takes a node from the tree's spares, mapping a slab of them
+ * when there are none.
+ */
+static interval_t *new_node(interval_tree_t *tree)
+{
+    if (tree->spare == NULL)
+    {
+        interval_t *slab = map_memory(SLAB_NODES * sizeof(interval_t));
+        slab->left = tree->slabs;
+        tree->slabs = slab;
+        for (int i = 1; i < SLAB_NODES; i++)
+        {
+            slab[i].left = tree->spare;
+            tree->spare = &slab[i];
+        }
+    }
+    interval_t *node = tree->spare;
+    tree->spare = node->left;
+    return node;
+}
+
+/*
+ * interval_insert - adds the range [start, end) of block id to the tree and
+ * rebalances it.
+ */
+void interval_insert(interval_tree_t *tree, uintptr_t start, uintptr_t end, int id)
+{
+    interval_t *node = new_node(tree);
+    interval_t *parent = NULL;
+    interval_t **link = &tree->root;
+
+    while (*link != NULL)
+    {
+        parent = *link;
+        if (end > parent->max_end)
+        {
+            parent->max_end = end;
+        }
+        link = before(start, id, parent) ? &parent->left : &parent->right;
+    }
+    node->start = start;
+    node->end = node->max_end = end;
+    node->id = id;
+    node->left = node->right = NULL;
+    node->parent = parent;
+    node->red = true;
+    *link = node;
+    tree->count++;
+
+    while ((parent = node->parent) != NULL && parent->red)
+    {
+        interval_t *grand = parent->parent;
+        bool left = (parent == grand->left);
+        interval_t *uncle = left ? grand->right : grand->left;
+
+        if (uncle != NULL && uncle->red)
+        {
+            parent->red = uncle->red = false;
+            grand->red = true;
+            node = grand;
+            continue;
+        }
+        if (node == (left ? parent->right : parent->left))
+        {
+            rotate(tree, parent, left);
+            node = parent;
+            parent = node->parent;
+        }
+        parent->red = false;
+        grand->red = true;
+        rotate(tree, grand, !left);
+    }
+    tree->root->red = false;
+}
+
+/*
+ * interval_remove - takes the range of block id starting at start out of
+ * the tree, if it is there, and rebalances it.
+ */
+void interval_remove(interval_tree_t *tree, uintptr_t start, int id)
+{
+    interval_t *node = tree->root;
+    while (node != NULL && (node->start != start || node->id != id))
+    {
+        node = before(start, id, node) ? node->left : node->right;
+    }
+    if (node == NULL)
+    {
+        return;
+    }
+
+    interval_t *child, *parent;
+    bool removed_red = node->red;
+
+    if (node->left == NULL || node->right == NULL)
+    {
+        child = (node->left != NULL) ? node->left : node->right;
+        parent = node->parent;
+        replace(tree, node, child);
+    }
+    else
+    {
+        interval_t *next = node->right;
+        while (next->left != NULL)
+        {
+            next = next->left;
+        }
+        removed_red = next->red;
+        child = next->right;
+        if (next->parent == node)
+        {
+            parent = next;
+        }
+        else
+        {
+            parent = next->parent;
+            replace(tree, next, child);
+            next->right = node->right;
+            next->right->parent = next;
+        }
+        replace(tree, node, next);
+        next->left = node->left;
+        next->left->parent = next;
+        next->red = node->red;
+    }
+
+    /* Every subtree that lost the range lies on the path up from parent */
+    for (interval_t *above = parent; above != NULL; above = above->parent)
+    {
+        update(above);
+    }
+
+    while (!removed_red && child != tree->root && (child == NULL || !child->red))
+    {
+        bool left = (child == parent->left);
+        interval_t *sibling = left ? parent->right : parent->left;
+
+        if (sibling->red)
+        {
+            sibling->red = false;
+            parent->red = true;
+            rotate(tree, parent, left);
+            sibling = left ? parent->right : parent->left;
+        }
+        interval_t *near = left ? sibling->left : sibling->right;
+        interval_t *far = left ? sibling->right : sibling->left;
+        if ((near == NULL || !near->red) && (far == NULL || !far->red))
+        {
+            sibling->red = true;
+            child = parent;
+            parent = child->parent;
+            continue;
+        }
+        if (far == NULL || !far->red)
+        {
+            near->red = false;
+            sibling->red = true;
+            rotate(tree, sibling, !left);
+            sibling = left ? parent->right : parent->left;
+            far = left ? sibling->right : sibling->left;
+        }
+        sibling->red = parent->red;
+        parent->red = false;
+        far->red = false;
+        rotate(tree, parent, left);
+        child = tree->root;
+    }
+    if (child != NULL)
+    {
+        child->red = false;
+    }
+    tree->count--;
+    node->left = tree->spare;
+    tree->spare = node;
+}
+
+/*
+ * interval_below - returns the range with the greatest start below addr, or
+ * NULL if there is none.
+ */
+interval_t *interval_below(interval_tree_t *tree, uintptr_t addr)
+{
+    interval_t *best = NULL;
+
+    for (interval_t *node = tree->root; node != NULL; )
+    {
+        if (node->start < addr)
+        {
+            best = node;
+            node = node->right;
+        }
+        else
+        {
+            node = node->left;
+        }
+    }
+    return best;
+}
+
+/*
+ * interval_from - returns the range with the least start at or above addr,
+ * or NULL if there is none.
+ */
+interval_t *interval_from(interval_tree_t *tree, uintptr_t addr)
+{
+    interval_t *best = NULL;
+
+    for (interval_t *node = tree->root; node != NULL; )
+    {
+        if (node->start >= addr)
+        {
+            best = node;
+            node = node->left;
+        }
+        else
+        {
+            node = node->right;
+        }
+    }
+    return best;
+}
+
+/*
+ * visit_node - visits the ranges under node that overlap [start, end) in
+ * order of start, skipping every subtree that ends before start.
+ */
+static int visit_node(interval_t *node, uintptr_t start, uintptr_t end, int (*visit)(interval_t *, void *),
+                      void *arg)
+{
+    int ret;
+
+    if (node == NULL || node->max_end <= start)
+    {
+        return 0;
+    }
+    if ((ret = visit_node(node->left, start, end, visit, arg)) != 0)
+    {
+        return ret;
+    }
+    if (node->start >= end)
+    {
+        return 0;
+    }
+    if (node->end > start && (ret = visit(node, arg)) != 0)
+    {
+        return ret;
+    }
+    return visit_node(node->right, start, end, visit, arg);
+}
+
+/*
+ * interval_visit - calls visit on every range that overlaps [start, end),
+ * in order of start, and stops at the first call that returns non-zero,
+ * returning what it returned. Returns 0 if every call did.
+ */
+int interval_visit(interval_tree_t *tree, uintptr_t start, uintptr_t end, int (*visit)(interval_t *, void *),
+                   void *arg)
+{
+    return visit_node(tree->root, start, end, visit, arg);
+}
+
+/*
+ * interval_clear - removes every range from the tree and unmaps its nodes.
+ */
+void interval_clear(interval_tree_t *tree)
+{
+    while (tree->slabs != NULL)
+    {
+        interval_t *slab = tree->slabs;
+        tree->slabs = slab->left;
+        unmap_memory(slab, SLAB_NODES * sizeof(interval_t));
+    }
+    tree->root = tree->spare = NULL;
+    tree->count = 0;
+}
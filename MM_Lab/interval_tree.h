@@ -0,0 +1,39 @@
+/**************************************************************************
+ * C S 429 MM-lab
+ *
+ * interval_tree.h - A red-black tree of address ranges, augmented with the
+ * largest end in every subtree, for finding the ranges that overlap or
+ * neighbour another in O(log n).
+ **************************************************************************/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* The range [start, end) of block id; nodes are ordered by start, then id */
+typedef struct interval {
+    uintptr_t start;
+    uintptr_t end;
+    uintptr_t max_end; /* largest end in the subtree under this node */
+    int id;
+    struct interval *left;
+    struct interval *right;
+    struct interval *parent;
+    bool red;
+} interval_t;
+
+/* Nodes come from slabs of map_memory, threaded through their left links */
+typedef struct {
+    interval_t *root;
+    size_t count;
+    interval_t *spare; /* nodes free for the next insert */
+    interval_t *slabs; /* every slab, through the left link of its first node */
+} interval_tree_t;
+
+void interval_insert(interval_tree_t *tree, uintptr_t start, uintptr_t end, int id);
+void interval_remove(interval_tree_t *tree, uintptr_t start, int id);
+interval_t *interval_below(interval_tree_t *tree, uintptr_t addr);
+interval_t *interval_from(interval_tree_t *tree, uintptr_t addr);
+int interval_visit(interval_tree_t *tree, uintptr_t start, uintptr_t end, int (*visit)(interval_t *, void *),
+                   void *arg);
+void interval_clear(interval_tree_t *tree);
@@ -0,0 +1,283 @@
+/**************************************************************************
+ * C S 429 MM-lab
+ *
+ * latency.c - Times every request of one or more traces on its own and
+ * reports the latency distribution per request type and size class, from
+ * log-bucketed histograms, along with the trace line of the slowest one.
+ **************************************************************************/
+
+#define _GNU_SOURCE /* sched_setaffinity */
+#include "umalloc.h"
+#include "support.h"
+#include <sched.h>
+
+#define SUB_BUCKET_BITS 4 /* linear buckets per power of two, as a power of two */
+#define SUB_BUCKETS (1 << SUB_BUCKET_BITS)
+#define MAX_POWER 40 /* latencies of 2^MAX_POWER ns or more land in the last bucket */
+#define BUCKETS ((MAX_POWER - SUB_BUCKET_BITS + 1) * SUB_BUCKETS)
+#define OP_TYPES 5 /* one histogram set per traceop_t type */
+#define ALL_CLASSES BIN_COUNT /* histogram index summing every size class */
+
+/* A histogram of latencies in ns, exact below SUB_BUCKETS and within 1/SUB_BUCKETS above. */
+typedef struct {
+    uint64_t counts[BUCKETS];
+    uint64_t total;
+    uint64_t max;
+} histogram_t;
+
+static const char *op_names[OP_TYPES] = {"alloc", "free", "realloc", "batch_alloc", "batch_free"};
+static histogram_t histograms[OP_TYPES][BIN_COUNT + 1];
+
+/* The slowest request seen in a trace. */
+static struct {
+    uint64_t ns;
+    int op;
+} worst;
+
+/*
+ * bucket_of - Returns the histogram bucket a latency of ns falls in.
+ */
+static int bucket_of(uint64_t ns) {
+    if (ns < SUB_BUCKETS) {
+        return ns;
+    }
+    int power = 63 - __builtin_clzl(ns);
+    if (power >= MAX_POWER) {
+        return BUCKETS - 1;
+    }
+    int sub = (ns >> (power - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+    return (power - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+/*
+ * bucket_top - Returns the largest latency that falls in bucket.
+ */
+static uint64_t bucket_top(int bucket) {
+    if (bucket < SUB_BUCKETS) {
+        return bucket;
+    }
+    int power = bucket / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+    uint64_t width = 1UL << (power - SUB_BUCKET_BITS);
+    return (1UL << power) + (bucket % SUB_BUCKETS) * width + width - 1;
+}
+
+static void record(histogram_t *histogram, uint64_t ns) {
+    histogram->counts[bucket_of(ns)]++;
+    histogram->total++;
+    if (ns > histogram->max) {
+        histogram->max = ns;
+    }
+}
+
+/*
+ * percentile - Returns the latency at or below which a fraction q of the
+ * samples in histogram fall, to the histogram's precision.
+ */
+static uint64_t percentile(histogram_t *histogram, double q) {
+    uint64_t rank = (uint64_t) (q * histogram->total + 0.999999);
+    uint64_t seen = 0;
+    if (rank == 0) {
+        rank = 1;
+    }
+    for (int bucket = 0; bucket < BUCKETS; bucket++) {
+        seen += histogram->counts[bucket];
+        if (seen >= rank) {
+            uint64_t top = bucket_top(bucket);
+            return (top < histogram->max) ? top : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000UL + now.tv_nsec;
+}
+
+/*
+ * run_trace - Replays the trace, timing each request on its own, and adds the
+ * times to the histograms if timed is set. An sbrk(4096) is made every 5 ops,
+ * outside the timed calls, if perturb is set.
+ */
+static void run_trace(trace_t *trace, void **scratch, bool timed, bool perturb) {
+    for (int curr_op = 0; curr_op < trace->num_ops; curr_op++) {
+        if (perturb && curr_op % 5 == 0) {
+            sbrk(4096);
+        }
+        traceop_t op = trace->ops[curr_op];
+        allocated_block_t *blocks = trace->blocks + op.index;
+        size_t size = (op.type == FREE || op.type == BATCH_FREE) ? blocks->block_size : op.size;
+        if (op.type == BATCH_FREE) {
+            for (int i = 0; i < op.count; i++) {
+                scratch[i] = blocks[i].payload;
+            }
+        }
+
+        uint64_t start = now_ns();
+        if (op.type == ALLOC) {
+            blocks->payload = umalloc(op.size);
+        } else if (op.type == REALLOC) {
+            blocks->payload = urealloc(blocks->payload, op.size);
+        } else if (op.type == BATCH_ALLOC) {
+            umalloc_batch(op.size, op.count, scratch);
+        } else if (op.type == BATCH_FREE) {
+            ufree_batch(scratch, op.count);
+        } else {
+            ufree(blocks->payload);
+        }
+        uint64_t ns = now_ns() - start;
+
+        if (op.type == ALLOC || op.type == REALLOC) {
+            blocks->block_size = op.size;
+        } else if (op.type == BATCH_ALLOC) {
+            for (int i = 0; i < op.count; i++) {
+                blocks[i].payload = scratch[i];
+                blocks[i].block_size = op.size;
+            }
+        }
+        if (timed) {
+            record(&histograms[op.type][find_bucket(size)], ns);
+            record(&histograms[op.type][ALL_CLASSES], ns);
+            if (ns > worst.ns) {
+                worst.ns = ns;
+                worst.op = curr_op;
+            }
+        }
+    }
+}
+
+/*
+ * reset_heap - Frees what the last replay left allocated, mapped blocks
+ * included, and resets the heap in place with ureset, so no replay pays for
+ * faulting in pages the one before it already touched.
+ */
+static void reset_heap(trace_t *trace, int *leftovers, int num_leftovers) {
+    for (int i = 0; i < num_leftovers; i++) {
+        ufree(trace->blocks[leftovers[i]].payload);
+    }
+    ureset();
+}
+
+static void print_row(char *name, int type, int class_id) {
+    histogram_t *histogram = &histograms[type][class_id];
+    if (histogram->total == 0) {
+        return;
+    }
+    if (class_id == ALL_CLASSES) {
+        printf("%s,%s,all,", name, op_names[type]);
+    } else {
+        printf("%s,%s,%d,", name, op_names[type], class_id);
+    }
+    printf("%lu,%lu,%lu,%lu,%lu\n", histogram->total, percentile(histogram, 0.5), percentile(histogram, 0.99),
+           percentile(histogram, 0.999), histogram->max);
+}
+
+/*
+ * measure - Replays the trace in file warmup times untimed and then replays
+ * times timed, each from a fresh heap, and prints its histogram rows and its
+ * slowest request.
+ */
+static void measure(char *file, int warmup, int replays, bool perturb) {
+    trace_t *trace = read_trace(file, 0);
+    int max_count = 1;
+    for (int curr_op = 0; curr_op < trace->num_ops; curr_op++) {
+        if (trace->ops[curr_op].count > max_count) {
+            max_count = trace->ops[curr_op].count;
+        }
+    }
+    void **scratch = calloc(max_count, sizeof(void *));
+    int *leftovers = calloc(trace->num_ids + 1, sizeof(int));
+    if (scratch == NULL || leftovers == NULL) {
+        appl_error("Failed to allocate replay arrays");
+    }
+    int num_leftovers = trace_leftovers(trace, leftovers);
+
+    memset(histograms, 0, sizeof(histograms));
+    worst.ns = 0;
+    worst.op = 0;
+    uinit();
+    for (int i = 0; i < warmup + replays; i++) {
+        run_trace(trace, scratch, i >= warmup, perturb);
+        reset_heap(trace, leftovers, num_leftovers);
+    }
+
+    for (int type = 0; type < OP_TYPES; type++) {
+        print_row(file, type, ALL_CLASSES);
+        for (int class_id = 0; class_id < BIN_COUNT; class_id++) {
+            print_row(file, type, class_id);
+        }
+    }
+    traceop_t op = trace->ops[worst.op];
+    size_t size = (op.type == FREE || op.type == BATCH_FREE) ? trace->blocks[op.index].block_size : op.size;
+    printf("# slowest: %s line %d, %s id %d size %lu, %lu ns\n", file, LINENUM(worst.op), op_names[op.type],
+           op.index, size, worst.ns);
+
+    free(leftovers);
+    free(scratch);
+    free_trace(trace);
+}
+
+static void usage(void) {
+    fprintf(stderr, "Usage: latency [-n replays] [-w warmup] [-c cpu] [-p] file...\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-n <num>   Timed replays of each trace (default: 1).\n");
+    fprintf(stderr, "\t-w <num>   Untimed warmup replays of each trace (default: 1).\n");
+    fprintf(stderr, "\t-c <cpu>   Pin the process to a cpu.\n");
+    fprintf(stderr, "\t-p         Make an untimed sbrk every 5 ops, as in graded runs.\n");
+    fprintf(stderr, "Prints CSV rows of request count and p50/p99/p99.9/max latency in ns per\n");
+    fprintf(stderr, "trace, request type and size class (all, then each class), followed by\n");
+    fprintf(stderr, "the trace line of the slowest request.\n");
+}
+
+int main(int argc, char **argv) {
+    int replays = 1, warmup = 1, cpu = -1;
+    bool perturb = false;
+    char c;
+
+    while ((c = getopt(argc, argv, "n:w:c:ph")) != EOF) {
+        switch (c) {
+        case 'n':
+            replays = atoi(optarg);
+            break;
+        case 'w':
+            warmup = atoi(optarg);
+            break;
+        case 'c':
+            cpu = atoi(optarg);
+            break;
+        case 'p':
+            perturb = true;
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+
+    if (optind >= argc) {
+        usage();
+        appl_error("No File parameter provided.");
+    }
+    if (replays <= 0 || warmup < 0) {
+        usage();
+        appl_error("Replay counts out of range.");
+    }
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+            appl_error("Failed to pin to the requested cpu");
+        }
+    }
+
+    printf("trace,op,class,count,p50_ns,p99_ns,p999_ns,max_ns\n");
+    for (int i = optind; i < argc; i++) {
+        measure(argv[i], warmup, replays, perturb);
+    }
+    return 0;
+}
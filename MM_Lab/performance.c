@@ -7,39 +7,390 @@
  * May not be used, modified, or copied without permission.
  **************************************************************************/
 
+#define _GNU_SOURCE /* sched_setaffinity */
 #include "umalloc.h"
 #include "support.h"
+#include <sched.h>
 
-static void run_trace(trace_t *trace) {
+#define COMPARE_WARMUP 1 /* untimed replays of each mode before a -b comparison */
+#define COMPARE_RUNS 5   /* timed replays of each mode in a -b comparison */
+
+/* How a trace is replayed. */
+typedef struct {
+    bool per_call; /* batch requests as one call per id */
+    bool sized;    /* single blocks freed with ufree_sized */
+    bool perturb;  /* an sbrk(4096) every 5 ops, as in graded runs */
+    bool reset;    /* a uinit at the start of the timed region */
+} replay_t;
+
+/*
+ * run_trace - Replays the trace and returns the time taken in nanoseconds.
+ * Batch requests go through umalloc_batch and ufree_batch, using scratch to
+ * hold their payloads, or one call per id if per_call is set. Blocks freed
+ * one at a time go through ufree_sized if sized is set.
+ */
+static uint64_t run_trace(trace_t *trace, void **scratch, replay_t how) {
+    bool per_call = how.per_call, sized = how.sized;
 
     struct timespec start, end;
     clock_gettime(CLOCK_MONOTONIC, &start);
-    uinit();
+    if (how.reset) {
+        uinit();
+    }
     for(size_t curr_op = 0; curr_op < trace->num_ops; curr_op++) {
-        if (curr_op % 5 == 0) {
+        if (how.perturb && curr_op % 5 == 0) {
             sbrk(4096);
         }
         traceop_t op = trace->ops[curr_op];
+        allocated_block_t *blocks = trace->blocks + op.index;
         if (op.type == ALLOC) {
-            trace->blocks[op.index].payload = umalloc(op.size);
+            blocks->payload = umalloc(op.size);
+            blocks->block_size = op.size;
+        } else if (op.type == REALLOC) {
+            blocks->payload = urealloc(blocks->payload, op.size);
+            blocks->block_size = op.size;
+        } else if (op.type == BATCH_ALLOC && per_call) {
+            for (int i = 0; i < op.count; i++) {
+                blocks[i].payload = umalloc(op.size);
+                blocks[i].block_size = op.size;
+            }
+        } else if (op.type == BATCH_ALLOC) {
+            umalloc_batch(op.size, op.count, scratch);
+            for (int i = 0; i < op.count; i++) {
+                blocks[i].payload = scratch[i];
+                blocks[i].block_size = op.size;
+            }
+        } else if (op.type == BATCH_FREE && per_call) {
+            for (int i = 0; i < op.count; i++) {
+                if (sized) {
+                    ufree_sized(blocks[i].payload, blocks[i].block_size);
+                } else {
+                    ufree(blocks[i].payload);
+                }
+            }
+        } else if (op.type == BATCH_FREE) {
+            for (int i = 0; i < op.count; i++) {
+                scratch[i] = blocks[i].payload;
+            }
+            ufree_batch(scratch, op.count);
+        } else if (sized) {
+            ufree_sized(blocks->payload, blocks->block_size);
         } else {
-            ufree(trace->blocks[op.index].payload);
+            ufree(blocks->payload);
         }
     }
     clock_gettime(CLOCK_MONOTONIC, &end);
-    uint64_t delta_us = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
-    printf("Success: %ld", delta_us);
+    return (end.tv_sec - start.tv_sec) * 1000000000 + (end.tv_nsec - start.tv_nsec);
+}
+
+/*
+ * stream_trace - Replays the trace in file as run_trace does, but reads it a
+ * chunk at a time through a trace stream and keeps the live blocks in a
+ * block map, so traces of any length replay in bounded memory. Returns the
+ * time spent replaying in nanoseconds, leaving out waits for the reader.
+ */
+static uint64_t stream_trace(char *file, replay_t how) {
+    trace_stream_t *stream = open_trace_stream(file, TRACE_CHUNK_OPS);
+    block_map_t *live = block_map_create();
+    int scratch_size = 1;
+    void **scratch = calloc(scratch_size, sizeof(void *));
+    if (scratch == NULL) {
+        appl_error("Failed to allocate batch array");
+    }
+
+    uint64_t ns = 0;
+    size_t curr_op = 0;
+    struct timespec start, end;
+    if (how.reset) {
+        uinit();
+    }
+    traceop_t *ops;
+    int count;
+    while ((ops = next_chunk(stream, &count)) != NULL) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < count; i++, curr_op++) {
+            if (how.perturb && curr_op % 5 == 0) {
+                sbrk(4096);
+            }
+            traceop_t op = ops[i];
+            if (op.count > scratch_size) {
+                scratch_size = op.count;
+                scratch = realloc(scratch, scratch_size * sizeof(void *));
+                if (scratch == NULL) {
+                    appl_error("Failed to grow batch array");
+                }
+            }
+            if (op.type == ALLOC || op.type == REALLOC) {
+                allocated_block_t *block = block_map_get(live, op.index);
+                block->payload = (op.type == ALLOC) ? umalloc(op.size) : urealloc(block->payload, op.size);
+                block->block_size = op.size;
+            } else if (op.type == BATCH_ALLOC) {
+                if (how.per_call) {
+                    for (int j = 0; j < op.count; j++) {
+                        scratch[j] = umalloc(op.size);
+                    }
+                } else {
+                    umalloc_batch(op.size, op.count, scratch);
+                }
+                for (int j = 0; j < op.count; j++) {
+                    allocated_block_t *block = block_map_get(live, op.index + j);
+                    block->payload = scratch[j];
+                    block->block_size = op.size;
+                }
+            } else {
+                int ids = (op.type == BATCH_FREE) ? op.count : 1;
+                for (int j = 0; j < ids; j++) {
+                    allocated_block_t *block = block_map_get(live, op.index + j);
+                    if (op.type == BATCH_FREE && !how.per_call) {
+                        scratch[j] = block->payload;
+                    } else if (how.sized) {
+                        ufree_sized(block->payload, block->block_size);
+                    } else {
+                        ufree(block->payload);
+                    }
+                    block_map_remove(live, op.index + j);
+                }
+                if (op.type == BATCH_FREE && !how.per_call) {
+                    ufree_batch(scratch, op.count);
+                }
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        ns += (end.tv_sec - start.tv_sec) * 1000000000 + (end.tv_nsec - start.tv_nsec);
+    }
+
+    free(scratch);
+    block_map_free(live);
+    close_trace_stream(stream);
+    return ns;
+}
+
+/*
+ * reset_heap - Frees what the last replay left allocated and resets the heap
+ * in place with ureset, so every timed replay starts from the same state in
+ * the same, already faulted, pages.
+ */
+static void reset_heap(trace_t *trace, int *leftovers, int num_leftovers) {
+    for (int i = 0; i < num_leftovers; i++) {
+        ufree(trace->blocks[leftovers[i]].payload);
+    }
+    ureset();
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * benchmark - Replays the trace warmup times untimed and then iterations
+ * times timed, resetting the heap before each, and prints the time per op
+ * of the fastest replay, the median replay and the p99 of replays, each a
+ * whole replay's time divided by its ops, and the ops/ms of the median one
+ * as CSV, or JSON if json is set.
+ */
+static void benchmark(char *name, trace_t *trace, void **scratch, replay_t how, int warmup, int iterations,
+                      bool json) {
+    int *leftovers = calloc(trace->num_ids + 1, sizeof(int));
+    uint64_t *times = calloc(iterations, sizeof(uint64_t));
+    if (leftovers == NULL || times == NULL) {
+        appl_error("Failed to allocate benchmark arrays");
+    }
+    int num_leftovers = trace_leftovers(trace, leftovers);
+
+    how.reset = false;
+    uinit();
+    for (int i = 0; i < warmup + iterations; i++) {
+        uint64_t ns = run_trace(trace, scratch, how);
+        if (i >= warmup) {
+            times[i - warmup] = ns;
+        }
+        reset_heap(trace, leftovers, num_leftovers);
+    }
+    qsort(times, iterations, sizeof(uint64_t), compare_u64);
+
+    double ops = trace->num_ops;
+    double min = times[0] / ops;
+    double median = times[iterations / 2] / ops;
+    double p99_of_replays = times[(iterations * 99 + 99) / 100 - 1] / ops;
+    double ops_per_ms = 1000000 / median;
+    if (json) {
+        printf("{\"trace\": \"%s\", \"ops\": %d, \"warmup\": %d, \"iterations\": %d, \"perturb\": %s, "
+               "\"min_ns_per_op\": %.1f, \"median_ns_per_op\": %.1f, \"p99_of_replays_ns_per_op\": %.1f, "
+               "\"ops_per_ms\": %.1f}\n", name, trace->num_ops, warmup, iterations, how.perturb ? "true" : "false",
+               min, median, p99_of_replays, ops_per_ms);
+    } else {
+        printf("trace,ops,warmup,iterations,perturb,min_ns_per_op,median_ns_per_op,p99_of_replays_ns_per_op,"
+               "ops_per_ms\n");
+        printf("%s,%d,%d,%d,%d,%.1f,%.1f,%.1f,%.1f\n", name, trace->num_ops, warmup, iterations, how.perturb,
+               min, median, p99_of_replays, ops_per_ms);
+    }
+    free(times);
+    free(leftovers);
+}
+
+/*
+ * compare_modes - Times the trace with batch requests through the batch API and as
+ * one call per id, COMPARE_RUNS times each after COMPARE_WARMUP untimed
+ * replays of both, from a reset heap every time. The mode that goes first
+ * alternates from run to run so neither gets the warmer caches, and the
+ * median replay of each is printed with the speedup between them.
+ */
+static void compare_modes(trace_t *trace, void **scratch, replay_t how) {
+    int *leftovers = calloc(trace->num_ids + 1, sizeof(int));
+    if (leftovers == NULL) {
+        appl_error("Failed to allocate leftover array");
+    }
+    int num_leftovers = trace_leftovers(trace, leftovers);
+    uint64_t batch[COMPARE_RUNS], per_call[COMPARE_RUNS];
+
+    how.reset = false;
+    uinit();
+    for (int run = 0; run < COMPARE_WARMUP + COMPARE_RUNS; run++) {
+        for (int turn = 0; turn < 2; turn++) {
+            how.per_call = (run + turn) % 2;
+            uint64_t ns = run_trace(trace, scratch, how);
+            reset_heap(trace, leftovers, num_leftovers);
+            if (run >= COMPARE_WARMUP) {
+                (how.per_call ? per_call : batch)[run - COMPARE_WARMUP] = ns;
+            }
+        }
+    }
+    qsort(batch, COMPARE_RUNS, sizeof(uint64_t), compare_u64);
+    qsort(per_call, COMPARE_RUNS, sizeof(uint64_t), compare_u64);
+
+    uint64_t batch_us = batch[COMPARE_RUNS / 2] / 1000;
+    uint64_t per_call_us = per_call[COMPARE_RUNS / 2] / 1000;
+    printf("Batch: %ld us, per-call: %ld us, speedup: %.2f\n", batch_us, per_call_us,
+           batch_us > 0 ? (double) per_call_us / batch_us : 0);
+    free(leftovers);
 }
 
+/*
+ * pin_cpu - Keeps the process on one cpu so replays are not migrated.
+ */
+static void pin_cpu(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        appl_error("Failed to pin to the requested cpu");
+    }
+}
 
+static void usage(void) {
+    fprintf(stderr, "Usage: performance [-bfS] [-n iterations [-w warmup] [-c cpu] [-p] [-o csv|json]] file\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-b         Time batch requests through the batch API and as one call per id (not with -n).\n");
+    fprintf(stderr, "\t-f         Free single blocks with ufree_sized, passing their trace size.\n");
+    fprintf(stderr, "\t-S         Stream the trace a chunk at a time instead of reading it whole.\n");
+    fprintf(stderr, "\t-n <num>   Benchmark: time num replays, each from a reset heap.\n");
+    fprintf(stderr, "\t-w <num>   Untimed warmup replays before a benchmark (default: 3).\n");
+    fprintf(stderr, "\t-c <cpu>   Pin the process to a cpu.\n");
+    fprintf(stderr, "\t-p         Keep the sbrk every 5 ops in a benchmark.\n");
+    fprintf(stderr, "\t-o <fmt>   Benchmark output as csv (default) or json.\n");
+    fprintf(stderr, "Without -n the trace is timed once, sbrk included, and the time printed in us.\n");
+    fprintf(stderr, "-b prints the median of %d replays of each mode, run in alternating order.\n", COMPARE_RUNS);
+    fprintf(stderr, "With -n the ns per op of the fastest replay, the median replay and the p99 of\n");
+    fprintf(stderr, "replays are printed, each a whole replay's time over its ops, not a per-op\n");
+    fprintf(stderr, "latency; latency times single ops.\n");
+}
 
 int main(int argc, char **argv) { 
-    if (argc < 2) {
-        fprintf(stderr, "Usage: performance file\n");
+    bool compare = false, sized = false, perturb = false, json = false, streamed = false;
+    int iterations = 0, warmup = 3, cpu = -1;
+    char c;
+
+    while ((c = getopt(argc, argv, "bfSn:w:c:po:h")) != EOF) {
+        switch (c) {
+        case 'b':
+            compare = true;
+            break;
+        case 'f':
+            sized = true;
+            break;
+        case 'S':
+            streamed = true;
+            break;
+        case 'n':
+            iterations = atoi(optarg);
+            break;
+        case 'w':
+            warmup = atoi(optarg);
+            break;
+        case 'c':
+            cpu = atoi(optarg);
+            break;
+        case 'p':
+            perturb = true;
+            break;
+        case 'o':
+            if (strcmp(optarg, "json") != 0 && strcmp(optarg, "csv") != 0) {
+                usage();
+                exit(1);
+            }
+            json = (strcmp(optarg, "json") == 0);
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+
+    if (optind >= argc) {
+        usage();
         appl_error("No File parameter provided.");
     }
-    trace_t *trace = read_trace(argv[1], 0);
-    run_trace(trace);
+    if (compare && iterations > 0) {
+        usage();
+        appl_error("-n benchmarks batch requests through the batch API only; it does not take -b.");
+    }
+    if (streamed) {
+        if (compare || iterations > 0) {
+            usage();
+            appl_error("-S times a single replay; it takes neither -b nor -n.");
+        }
+        if (cpu >= 0) {
+            pin_cpu(cpu);
+        }
+        replay_t how = {.per_call = false, .sized = sized, .perturb = true, .reset = true};
+        printf("Success: %ld", stream_trace(argv[optind], how) / 1000);
+        return 0;
+    }
+    trace_t *trace = read_trace(argv[optind], 0);
+
+    int max_count = 1;
+    for (size_t curr_op = 0; curr_op < trace->num_ops; curr_op++) {
+        if (trace->ops[curr_op].count > max_count) {
+            max_count = trace->ops[curr_op].count;
+        }
+    }
+    void **scratch = calloc(max_count, sizeof(void *));
+    if (scratch == NULL) {
+        appl_error("Failed to allocate batch array");
+    }
+
+    if (warmup < 0 || iterations < 0) {
+        usage();
+        appl_error("Replay counts must not be negative.");
+    }
+    if (cpu >= 0) {
+        pin_cpu(cpu);
+    }
+
+    replay_t how = {.per_call = false, .sized = sized, .perturb = true, .reset = true};
+    if (iterations > 0) {
+        how.perturb = perturb;
+        benchmark(argv[optind], trace, scratch, how, warmup, iterations, json);
+    } else if (compare) {
+        compare_modes(trace, scratch, how);
+    } else {
+        printf("Success: %ld", run_trace(trace, scratch, how) / 1000);
+    }
+    free(scratch);
     free_trace(trace);
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,263 @@
+/**************************************************************************
+ * C S 429 MM-lab
+ *
+ * performance_mt.c - Replays one trace per thread against the shared umalloc
+ * heap and reports how throughput scales with the number of threads. With -x
+ * every trace is split across two threads: one allocates, the other frees.
+ **************************************************************************/
+
+#include "umalloc.h"
+#include "support.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+#define MAX_THREADS 64
+#define HANDOFF_SLOTS 4096 /* payloads in flight from an allocating to a freeing thread */
+
+/* A single-producer, single-consumer ring of payloads waiting to be freed. */
+typedef struct {
+    trace_t *trace;
+    void *slots[HANDOFF_SLOTS];
+    _Atomic size_t head; /* next slot the allocating thread fills */
+    _Atomic size_t tail; /* next slot the freeing thread empties */
+    atomic_bool done;
+} handoff_t;
+
+static pthread_barrier_t start_barrier;
+
+/*
+ * batch_alloc - Allocates the ids of a batch request through umalloc_batch,
+ * using scratch to hold the payloads.
+ */
+static void batch_alloc(trace_t *trace, traceop_t op, void **scratch) {
+    umalloc_batch(op.size, op.count, scratch);
+    for (int i = 0; i < op.count; i++) {
+        trace->blocks[op.index + i].payload = scratch[i];
+    }
+}
+
+/*
+ * replay - Thread body: waits for every thread to be ready, then runs its own
+ * trace to completion.
+ */
+static void *replay(void *arg) {
+    trace_t *trace = arg;
+    void **scratch = calloc(trace->num_ids, sizeof(void *));
+    if (scratch == NULL) {
+        appl_error("Failed to allocate batch array");
+    }
+    pthread_barrier_wait(&start_barrier);
+    for (size_t curr_op = 0; curr_op < trace->num_ops; curr_op++) {
+        traceop_t op = trace->ops[curr_op];
+        if (op.type == ALLOC) {
+            trace->blocks[op.index].payload = umalloc(op.size);
+        } else if (op.type == REALLOC) {
+            trace->blocks[op.index].payload = urealloc(trace->blocks[op.index].payload, op.size);
+        } else if (op.type == BATCH_ALLOC) {
+            batch_alloc(trace, op, scratch);
+        } else if (op.type == BATCH_FREE) {
+            for (int i = 0; i < op.count; i++) {
+                scratch[i] = trace->blocks[op.index + i].payload;
+            }
+            ufree_batch(scratch, op.count);
+        } else {
+            ufree(trace->blocks[op.index].payload);
+        }
+    }
+    free(scratch);
+    return NULL;
+}
+
+/*
+ * handoff_push - Waits for a free slot and hands a payload to the freeing
+ * thread.
+ */
+static void handoff_push(handoff_t *handoff, void *payload) {
+    size_t head = atomic_load_explicit(&handoff->head, memory_order_relaxed);
+    while (head - atomic_load_explicit(&handoff->tail, memory_order_acquire) == HANDOFF_SLOTS) {
+        sched_yield();
+    }
+    handoff->slots[head % HANDOFF_SLOTS] = payload;
+    atomic_store_explicit(&handoff->head, head + 1, memory_order_release);
+}
+
+/*
+ * replay_alloc - Thread body for -x: runs the trace's allocations and
+ * reallocations and hands every payload the trace frees to the partner thread.
+ */
+static void *replay_alloc(void *arg) {
+    handoff_t *handoff = arg;
+    trace_t *trace = handoff->trace;
+    void **scratch = calloc(trace->num_ids, sizeof(void *));
+    if (scratch == NULL) {
+        appl_error("Failed to allocate batch array");
+    }
+    pthread_barrier_wait(&start_barrier);
+    for (size_t curr_op = 0; curr_op < trace->num_ops; curr_op++) {
+        traceop_t op = trace->ops[curr_op];
+        if (op.type == ALLOC) {
+            trace->blocks[op.index].payload = umalloc(op.size);
+        } else if (op.type == REALLOC) {
+            trace->blocks[op.index].payload = urealloc(trace->blocks[op.index].payload, op.size);
+        } else if (op.type == BATCH_ALLOC) {
+            batch_alloc(trace, op, scratch);
+        } else if (op.type == BATCH_FREE) {
+            for (int i = 0; i < op.count; i++) {
+                handoff_push(handoff, trace->blocks[op.index + i].payload);
+            }
+        } else {
+            handoff_push(handoff, trace->blocks[op.index].payload);
+        }
+    }
+    atomic_store_explicit(&handoff->done, true, memory_order_release);
+    free(scratch);
+    return NULL;
+}
+
+/*
+ * replay_free - Thread body for -x: frees whatever the partner thread hands
+ * over until it is done.
+ */
+static void *replay_free(void *arg) {
+    handoff_t *handoff = arg;
+    pthread_barrier_wait(&start_barrier);
+    size_t tail = 0;
+    while (1) {
+        bool done = atomic_load_explicit(&handoff->done, memory_order_acquire);
+        size_t head = atomic_load_explicit(&handoff->head, memory_order_acquire);
+        if (tail == head) {
+            if (done) {
+                break;
+            }
+            sched_yield();
+            continue;
+        }
+        for (; tail != head; tail++) {
+            ufree(handoff->slots[tail % HANDOFF_SLOTS]);
+        }
+        atomic_store_explicit(&handoff->tail, tail, memory_order_release);
+    }
+    return NULL;
+}
+
+/*
+ * run_threads - Replays traces[0..count) at once, on one thread each or on an
+ * allocating/freeing pair each when cross is set, and returns the wall time
+ * in microseconds.
+ */
+static uint64_t run_threads(trace_t **traces, handoff_t *handoffs, int count, bool cross) {
+    pthread_t threads[2 * MAX_THREADS];
+    struct timespec start, end;
+    int num_threads = cross ? 2 * count : count;
+
+    pthread_barrier_init(&start_barrier, NULL, num_threads + 1);
+    for (int i = 0; i < count; i++) {
+        int err;
+        if (cross) {
+            handoffs[i].trace = traces[i];
+            atomic_store(&handoffs[i].head, 0);
+            atomic_store(&handoffs[i].tail, 0);
+            atomic_store(&handoffs[i].done, false);
+            err = pthread_create(&threads[2 * i], NULL, replay_alloc, &handoffs[i])
+                || pthread_create(&threads[2 * i + 1], NULL, replay_free, &handoffs[i]);
+        } else {
+            err = pthread_create(&threads[i], NULL, replay, traces[i]);
+        }
+        if (err != 0) {
+            appl_error("Failed to create replay thread");
+        }
+    }
+    pthread_barrier_wait(&start_barrier);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    pthread_barrier_destroy(&start_barrier);
+
+    return (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
+}
+
+static void usage(void) {
+    fprintf(stderr, "Usage: performance_mt [-x] [-t threads] file...\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-t <num>   Largest thread count to measure (default: one per file).\n");
+    fprintf(stderr, "\t-x         Free every block on a different thread than allocated it.\n");
+    fprintf(stderr, "Thread i replays file i modulo the number of files; the thread count\n");
+    fprintf(stderr, "doubles from 1 up to the maximum.\n");
+}
+
+int main(int argc, char **argv) {
+    int max_threads = 0;
+    bool cross = false;
+    char c;
+
+    while ((c = getopt(argc, argv, "t:xh")) != EOF) {
+        switch (c) {
+        case 't':
+            max_threads = atoi(optarg);
+            break;
+        case 'x':
+            cross = true;
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+
+    int num_files = argc - optind;
+    if (num_files < 1) {
+        usage();
+        appl_error("No File parameter provided.");
+    }
+    if (max_threads <= 0) {
+        max_threads = num_files;
+    }
+    if (max_threads > MAX_THREADS) {
+        max_threads = MAX_THREADS;
+    }
+
+    /* Every thread gets its own copy so the block arrays are not shared. */
+    trace_t *traces[MAX_THREADS];
+    uint64_t ops_per_thread[MAX_THREADS];
+    for (int i = 0; i < max_threads; i++) {
+        traces[i] = read_trace(argv[optind + i % num_files], 0);
+        ops_per_thread[i] = traces[i]->num_ops;
+    }
+
+    handoff_t *handoffs = calloc(max_threads, sizeof(handoff_t));
+    if (handoffs == NULL) {
+        appl_error("Failed to allocate handoff rings");
+    }
+
+    uinit();
+    printf("traces,threads,ops,time_us,ops_per_ms,speedup\n");
+    double base = 0;
+    for (int count = 1; ; count = (count * 2 > max_threads && count < max_threads) ? max_threads : count * 2) {
+        uint64_t ops = 0;
+        for (int i = 0; i < count; i++) {
+            ops += ops_per_thread[i];
+        }
+        uint64_t delta_us = run_threads(traces, handoffs, count, cross);
+        double ops_per_ms = (delta_us == 0) ? 0 : ops * 1000.0 / delta_us;
+        if (count == 1) {
+            base = ops_per_ms;
+        }
+        printf("%d,%d,%lu,%lu,%.2f,%.2f\n", count, cross ? 2 * count : count, ops, delta_us,
+               ops_per_ms, base > 0 ? ops_per_ms / base : 0);
+        if (count >= max_threads) {
+            break;
+        }
+    }
+
+    for (int i = 0; i < max_threads; i++) {
+        free_trace(traces[i]);
+    }
+    free(handoffs);
+    return 0;
+}
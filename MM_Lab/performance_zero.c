@@ -0,0 +1,125 @@
+/**************************************************************************
+ * C S 429 MM-lab
+ *
+ * performance_zero.c - Compares zeroed allocations made with umalloc and
+ * memset against ucalloc, which skips clearing memory it knows is zero, and
+ * reports the time saved for each allocation size.
+ **************************************************************************/
+
+#include "umalloc.h"
+#include "support.h"
+
+#define MAX_ALLOCS 4096
+
+static const size_t default_sizes[] = {4096, 16384, 32768, 65536, 262144, 1048576, 4194304};
+
+/*
+ * run_zeroed - Makes count zeroed allocations of size bytes from a fresh
+ * heap, touching the first byte of each as a user would, then frees them.
+ * Returns the time taken in microseconds.
+ */
+static uint64_t run_zeroed(void **ptrs, int count, size_t size, bool use_calloc) {
+    struct timespec start, end;
+
+    uinit();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < count; i++) {
+        if (use_calloc) {
+            ptrs[i] = ucalloc(1, size);
+        } else {
+            ptrs[i] = umalloc(size);
+            if (ptrs[i] != NULL) {
+                memset(ptrs[i], 0, size);
+            }
+        }
+        if (ptrs[i] == NULL) {
+            appl_error("Zeroed allocation failed");
+        }
+        *(volatile char *) ptrs[i] = 1;
+    }
+    for (int i = 0; i < count; i++) {
+        ufree(ptrs[i]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
+}
+
+static void usage(void) {
+    fprintf(stderr, "Usage: performance_zero [-n count] [size...]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-n <num>   Allocations per size and method (default: 64).\n");
+    fprintf(stderr, "Every size is allocated count times with umalloc followed by memset\n");
+    fprintf(stderr, "and count times with ucalloc, each from a fresh heap. After an untimed run\n");
+    fprintf(stderr, "of each, both are timed in both orders and the mean of the two printed.\n");
+}
+
+int main(int argc, char **argv) {
+    int count = 64;
+    char c;
+
+    while ((c = getopt(argc, argv, "n:h")) != EOF) {
+        switch (c) {
+        case 'n':
+            count = atoi(optarg);
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (count <= 0 || count > MAX_ALLOCS) {
+        usage();
+        appl_error("Allocation count out of range.");
+    }
+
+    size_t num_sizes = argc - optind;
+    size_t *sizes = (size_t *) default_sizes;
+    if (num_sizes == 0) {
+        num_sizes = sizeof(default_sizes) / sizeof(default_sizes[0]);
+    } else {
+        sizes = calloc(num_sizes, sizeof(size_t));
+        if (sizes == NULL) {
+            appl_error("Failed to allocate size array");
+        }
+        for (size_t i = 0; i < num_sizes; i++) {
+            sizes[i] = strtoul(argv[optind + i], NULL, 0);
+        }
+    }
+
+    void **ptrs = calloc(count, sizeof(void *));
+    if (ptrs == NULL) {
+        appl_error("Failed to allocate pointer array");
+    }
+
+    printf("size,count,memset_us,ucalloc_us,saved_us,speedup\n");
+    for (size_t i = 0; i < num_sizes; i++) {
+        // Untimed runs of both first, then both orders, so neither method
+        // gains from going second.
+        run_zeroed(ptrs, count, sizes[i], false);
+        run_zeroed(ptrs, count, sizes[i], true);
+        uint64_t memset_us = 0, calloc_us = 0;
+        for (int turn = 0; turn < 4; turn++) {
+            bool use_calloc = (turn == 1 || turn == 2);
+            uint64_t us = run_zeroed(ptrs, count, sizes[i], use_calloc);
+            if (use_calloc) {
+                calloc_us += us;
+            } else {
+                memset_us += us;
+            }
+        }
+        memset_us /= 2;
+        calloc_us /= 2;
+        printf("%lu,%d,%lu,%lu,%ld,%.2f\n", sizes[i], count, memset_us, calloc_us,
+               (int64_t) (memset_us - calloc_us), calloc_us > 0 ? (double) memset_us / calloc_us : 0);
+    }
+
+    if (sizes != default_sizes) {
+        free(sizes);
+    }
+    free(ptrs);
+    return 0;
+}
@@ -11,27 +11,47 @@
  #include "csbrk.h"
  #include "support.h"
  #include "check_heap.h"
+ #include "interval_tree.h"
  #include <sys/mman.h>
  
  int verbose = 0;
+ size_t alloc_align = 0; /* allocate through ualigned_alloc when set */
+ int sized_free = 0;      /* free through ufree_sized when set */
+ block_map_t *live = NULL; /* blocks by id when the trace is streamed, in place of trace->blocks */
+ size_t sweep_interval = 1000; /* ops between full correctness sweeps, 0 for only at the end */
+ interval_tree_t live_ranges; /* payload ranges of the allocated blocks */
+ 
+ /* The payload ranges the current op handed out or took back, in map_memory */
+ struct range
+ {
+     uintptr_t start;
+     uintptr_t end;
+ } *touched;
+ size_t num_touched, max_touched;
  extern char msg[MAXLINE]; /* for whenever we need to compose an error message */
  extern size_t sbrk_bytes;
+ extern size_t mmap_bytes;
  extern const char author[];
- extern mem_block_header_t *select_bin(size_t);
- extern mem_block_header_t *free_heads[BIN_COUNT];
  
  /*
   * usage - Explain the command line arguments
   */
  static void usage(void)
  {
-     fprintf(stderr, "Usage: mdriver [-rhvuc] file\n");
+     fprintf(stderr, "Usage: mdriver [-rhvucfsS] [-a align] [-i ops] file\n");
      fprintf(stderr, "Options\n");
      fprintf(stderr, "\t-r         Run the trace to completion (bypass interface).\n");
      fprintf(stderr, "\t-h         Print this message.\n");
      fprintf(stderr, "\t-v         Print additional debug info.\n");
      fprintf(stderr, "\t-u         Display heap utilization.\n");
-     fprintf(stderr, "\t-c         Runs the user provided heap check after every op.\n");
+     fprintf(stderr, "\t-c         Check the heap after every op: a sample of it, or all of\n");
+     fprintf(stderr, "\t           it on the ops that check every block (see -i).\n");
+     fprintf(stderr, "\t-a <align> Allocate every block with ualigned_alloc(align, size).\n");
+     fprintf(stderr, "\t-f         Free single blocks with ufree_sized, passing their trace size.\n");
+     fprintf(stderr, "\t-s         Print the allocator's ustats after the trace.\n");
+     fprintf(stderr, "\t-i <ops>   Check every allocated block every ops ops (default: 1000, 0: only at the end);\n");
+     fprintf(stderr, "\t           other ops only check the blocks around the ones they touch.\n");
+     fprintf(stderr, "\t-S         Stream the trace a chunk at a time instead of reading it whole (with -r).\n");
  }
  
  /*
@@ -65,6 +85,42 @@
      return 0;
  }
  
+ /*
+  * block_of - Returns the block of id, from the live map if the trace is
+  * streamed.
+  */
+ static allocated_block_t *block_of(trace_t *trace, int id)
+ {
+     return (live != NULL) ? block_map_get(live, id) : &trace->blocks[id];
+ }
+ 
+ /*
+  * release_block - Forgets a freed block when the trace is streamed, so the
+  * live map only holds allocated ids.
+  */
+ static void release_block(int id)
+ {
+     if (live != NULL)
+     {
+         block_map_remove(live, id);
+     }
+ }
+ 
+ /*
+  * check_block - Checks an allocated block still holds its id, reporting it
+  * as corrupted by curr_op if not.
+  */
+ static int check_block(allocated_block_t *block, size_t block_id, size_t curr_op)
+ {
+     if (block->is_allocated && check_id(block->payload, block->block_size, block->content_val) == -1)
+     {
+         sprintf(msg, "umalloc corrupted block id %lu.", block_id);
+         malloc_error(curr_op, msg);
+         return -1;
+     }
+     return 0;
+ }
+ 
  /*
   * check_correctness - Checks if every block that is mark allocated has the
   * correct id written out. If this fails, means that an allocated payload
@@ -72,47 +128,188 @@
   */
  static int check_correctness(trace_t *trace, size_t curr_op)
  {
-     for (size_t block_id = 0; block_id < trace->num_ids; block_id++)
+     size_t slots = (live != NULL) ? live->capacity : trace->num_ids;
+     for (size_t slot = 0; slot < slots; slot++)
      {
-         allocated_block_t *block = &trace->blocks[block_id];
-         if (block->is_allocated)
+         allocated_block_t *block = (live != NULL) ? &live->blocks[slot] : &trace->blocks[slot];
+         size_t block_id = (live != NULL) ? live->ids[slot] : slot;
+         if (check_block(block, block_id, curr_op) == -1)
          {
-             if (check_id(block->payload, block->block_size, block->content_val) == -1)
-             {
-                 sprintf(msg, "umalloc corrupted block id %lu.", block_id);
-                 malloc_error(curr_op, msg);
-                 return -1;
-             }
+             return -1;
          }
      }
  
-     if (verbose)
+     return 0;
+ }
+ 
+ /* What check_range needs to look a block up and report it */
+ struct range_check
+ {
+     trace_t *trace;
+     size_t curr_op;
+ };
+ 
+ /*
+  * check_range - Checks the block of a live payload range, for
+  * interval_visit.
+  */
+ static int check_range(interval_t *range, void *arg)
+ {
+     struct range_check *check = arg;
+     return check_block(block_of(check->trace, range->id), range->id, check->curr_op);
+ }
+ 
+ /*
+  * check_touched - Checks the blocks whose payloads overlap a range the op
+  * touched, and the nearest block on either side of it, which is where the
+  * headers and footers umalloc writes for the range lie. Blocks further away
+  * are left to the full sweep.
+  */
+ static int check_touched(trace_t *trace, size_t curr_op)
+ {
+     struct range_check check = {trace, curr_op};
+ 
+     for (size_t i = 0; i < num_touched; i++)
      {
-         printf("line %ld passed the correctness check.\n", LINENUM(curr_op));
+         interval_t *below = interval_below(&live_ranges, touched[i].start);
+         interval_t *above = interval_from(&live_ranges, touched[i].end);
+         if (interval_visit(&live_ranges, touched[i].start, touched[i].end, check_range, &check) != 0
+             || (below != NULL && check_range(below, &check) != 0)
+             || (above != NULL && check_range(above, &check) != 0))
+         {
+             return -1;
+         }
      }
- 
      return 0;
  }
  
+ /*
+  * touch - Notes a payload range the current op handed out or took back.
+  */
+ static void touch(void *payload, size_t size)
+ {
+     if (num_touched == max_touched)
+     {
+         size_t grown = (max_touched == 0) ? 256 : 2 * max_touched;
+         struct range *ranges = map_memory(grown * sizeof(struct range));
+         if (max_touched != 0)
+         {
+             memcpy(ranges, touched, max_touched * sizeof(struct range));
+             unmap_memory(touched, max_touched * sizeof(struct range));
+         }
+         touched = ranges;
+         max_touched = grown;
+     }
+     touched[num_touched].start = (uintptr_t)payload;
+     touched[num_touched].end = (uintptr_t)payload + size;
+     num_touched++;
+ }
+ 
  size_t curr_bytes_in_use;
  size_t max_bytes_in_use;
+ size_t max_heap_bytes; /* peak of sbrk_bytes plus the bytes umalloc mapped itself */
  
  /*
   * UTILIZATION_SCORE - the utilization score represents how well the umalloc
-  * package uses the bytes requested from sbrk. For example, if 100 bytes are
-  * requested from sbrk, and the user requested 80 bytes, there will be a
-  * utilization score of 80%.
+  * package uses the bytes requested from sbrk (and mmap, for large blocks).
+  * For example, if 100 bytes are requested from sbrk, and the user requested
+  * 80 bytes, there will be a utilization score of 80%.
+  */
+ #define UTILIZATION_SCORE 100.0 * max_bytes_in_use / max_heap_bytes
+ 
+ /*
+  * update_heap_bytes - Records the current footprint if it is a new peak.
   */
- #define UTILIZATION_SCORE 100.0 * max_bytes_in_use / sbrk_bytes
+ static void update_heap_bytes(void)
+ {
+     if (sbrk_bytes + mmap_bytes > max_heap_bytes)
+     {
+         max_heap_bytes = sbrk_bytes + mmap_bytes;
+     }
+ }
+ 
+ /*
+  * first_range - Stops interval_visit at the first range, storing it in arg.
+  */
+ static int first_range(interval_t *range, void *arg)
+ {
+     *(interval_t **)arg = range;
+     return 1;
+ }
+ 
+ /*
+  * check_overlap - Checks a payload umalloc returned for curr_op does not
+  * overlap a block that is still allocated, naming that block and the line
+  * that last placed it if it does.
+  */
+ static int check_overlap(trace_t *trace, void *payload, size_t size, size_t curr_op)
+ {
+     interval_t *range = NULL;
+     if (interval_visit(&live_ranges, (uintptr_t)payload, (uintptr_t)payload + size, first_range, &range) == 0)
+     {
+         return 0;
+     }
+ 
+     sprintf(msg, "umalloc returned a payload overlapping block id %d from line %ld.", range->id,
+             LINENUM(block_of(trace, range->id)->content_val));
+     malloc_error(curr_op, msg);
+     return -1;
+ }
+ 
+ /*
+  * place_block - Records a block umalloc returned for id index and checks
+  * it is not NULL, is aligned to 16 bytes (and align, if set), rests
+  * within the sbrk range or a block umalloc mapped itself and overlaps no
+  * allocated block, then fills it with the current op's id.
+  */
+ static int place_block(trace_t *trace, size_t curr_op, int index, int size, void *payload, size_t align)
+ {
+     allocated_block_t *block = block_of(trace, index);
+     block->is_allocated = true;
+     block->content_val = curr_op;
+     block->block_size = size;
+     block->payload = payload;
+     curr_bytes_in_use += size;
+ 
+     if (payload == NULL)
+     {
+         malloc_error(curr_op, "umalloc failed.");
+         return -1;
+     }
+ 
+     if (((size_t)payload) % ALIGNMENT != 0 || (align != 0 && ((size_t)payload) % align != 0))
+     {
+         malloc_error(curr_op, "umalloc returned an unaligned payload.");
+         return -1;
+     }
+ 
+     if (check_malloc_output(payload, size) == -1 && !is_mapped(payload, size))
+     {
+         printf("line %ld: umalloc allocated a block out of bounds.\n", LINENUM(curr_op));
+         return -1;
+     }
+ 
+     if (check_overlap(trace, payload, size, curr_op) == -1)
+     {
+         return -1;
+     }
+ 
+     interval_insert(&live_ranges, (uintptr_t)payload, (uintptr_t)payload + size, index);
+     touch(payload, size);
+     copy_id((size_t *)payload, size, curr_op);
+     return 0;
+ }
  
  /*
   * run_trace_line - Runs a single line in the trace. Checking if all the
   * correctness checks are still satisfied after the check. Checks if the returned
-  * payload is aligned to 16 bytes, hasn't affected any other blocks, and rests
-  * within the sbrk range. Runs the user created check heap function and prints
-  * the current utilization score if requested.
+  * payload is aligned to 16 bytes, overlaps no allocated block, hasn't affected
+  * any other blocks, and rests within the sbrk range or a block umalloc mapped
+  * itself. A reallocated block
+  * must also still hold its old contents. Runs the user created check heap
+  * function and prints the current utilization score if requested.
   */
- static int run_trace_line(trace_t *trace, size_t curr_op, int utilization, int run_check_heap)
+ static int run_trace_line(trace_t *trace, traceop_t op, size_t curr_op, int utilization, int run_check_heap)
  {
  
      if (curr_op % 5 == 0)
@@ -120,61 +317,159 @@
          void *ret = sbrk(4096);
          mprotect(ret, 4096, PROT_NONE);
      }
-     traceop_t op = trace->ops[curr_op];
+     num_touched = 0;
      if (op.type == ALLOC)
      {
-         trace->blocks[op.index].is_allocated = true;
-         trace->blocks[op.index].content_val = curr_op;
-         trace->blocks[op.index].block_size = op.size;
- 
          if (verbose)
          {
              printf("line %ld: umalloc: id %d, Allocating %d bytes\n", LINENUM(curr_op), op.index, op.size);
          }
  
-         trace->blocks[op.index].payload = umalloc(op.size);
-         curr_bytes_in_use += op.size;
-         if (trace->blocks[op.index].payload == NULL)
+         void *payload = (alloc_align != 0) ? ualigned_alloc(alloc_align, op.size) : umalloc(op.size);
+         if (place_block(trace, curr_op, op.index, op.size, payload, alloc_align) == -1)
+         {
+             return -1;
+         }
+     }
+     else if (op.type == BATCH_ALLOC)
+     {
+         if (verbose)
+         {
+             printf("line %ld: umalloc_batch: ids %d-%d, Allocating %d bytes each\n", LINENUM(curr_op), op.index,
+                    op.index + op.count - 1, op.size);
+         }
+ 
+         void **payloads = calloc(op.count, sizeof(void *));
+         if (payloads == NULL)
+         {
+             appl_error("Failed to allocate batch array");
+         }
+         umalloc_batch(op.size, op.count, payloads);
+         for (int i = 0; i < op.count; i++)
+         {
+             if (place_block(trace, curr_op, op.index + i, op.size, payloads[i], 0) == -1)
+             {
+                 free(payloads);
+                 return -1;
+             }
+         }
+         free(payloads);
+     }
+     else if (op.type == REALLOC)
+     {
+         allocated_block_t *block = block_of(trace, op.index);
+         size_t old_size = block->is_allocated ? block->block_size : 0;
+         size_t kept = (old_size < op.size) ? old_size : op.size;
+ 
+         if (verbose)
+         {
+             printf("line %ld: urealloc: id %d, Reallocating %d bytes\n", LINENUM(curr_op), op.index, op.size);
+         }
+ 
+         if (block->is_allocated)
+         {
+             interval_remove(&live_ranges, (uintptr_t)block->payload, op.index);
+             touch(block->payload, old_size);
+         }
+         block->payload = urealloc(block->is_allocated ? block->payload : NULL, op.size);
+         curr_bytes_in_use += op.size - old_size;
+         block->block_size = op.size;
+         if (block->payload == NULL)
          {
-             malloc_error(curr_op, "umalloc failed.");
+             block->is_allocated = false;
+             malloc_error(curr_op, "urealloc failed.");
              return -1;
          }
+         block->is_allocated = true;
  
-         if (((size_t)trace->blocks[op.index].payload) % ALIGNMENT != 0)
+         if (((size_t)block->payload) % ALIGNMENT != 0)
          {
-             malloc_error(curr_op, "umalloc returned an unaligned payload.");
+             malloc_error(curr_op, "urealloc returned an unaligned payload.");
              return -1;
          }
  
-         if (check_malloc_output(trace->blocks[op.index].payload, trace->blocks[op.index].block_size) == -1)
+         if (check_malloc_output(block->payload, block->block_size) == -1 && !is_mapped(block->payload, block->block_size))
          {
-             printf("line %ld: umalloc allocated a block out of bounds.\n", LINENUM(curr_op));
+             printf("line %ld: urealloc allocated a block out of bounds.\n", LINENUM(curr_op));
              return -1;
          }
  
-         copy_id((size_t *)trace->blocks[op.index].payload, trace->blocks[op.index].block_size, curr_op);
+         if (check_overlap(trace, block->payload, op.size, curr_op) == -1)
+         {
+             return -1;
+         }
+ 
+         if (check_id((size_t *)block->payload, kept, block->content_val) == -1)
+         {
+             malloc_error(curr_op, "urealloc did not preserve the block's contents.");
+             return -1;
+         }
+ 
+         interval_insert(&live_ranges, (uintptr_t)block->payload, (uintptr_t)block->payload + op.size, op.index);
+         touch(block->payload, op.size);
+         block->content_val = curr_op;
+         copy_id((size_t *)block->payload, block->block_size, curr_op);
+     }
+     else if (op.type == BATCH_FREE)
+     {
+         if (verbose)
+         {
+             printf("line %ld: ufree_batch: ids %d-%d\n", LINENUM(curr_op), op.index, op.index + op.count - 1);
+         }
+ 
+         void **payloads = calloc(op.count, sizeof(void *));
+         if (payloads == NULL)
+         {
+             appl_error("Failed to allocate batch array");
+         }
+         for (int i = 0; i < op.count; i++)
+         {
+             allocated_block_t *block = block_of(trace, op.index + i);
+             block->is_allocated = false;
+             payloads[i] = block->payload;
+             curr_bytes_in_use -= block->block_size;
+             interval_remove(&live_ranges, (uintptr_t)block->payload, op.index + i);
+             touch(block->payload, block->block_size);
+             release_block(op.index + i);
+         }
+         ufree_batch(payloads, op.count);
+         free(payloads);
      }
      else
      {
-         trace->blocks[op.index].is_allocated = false;
+         allocated_block_t *block = block_of(trace, op.index);
+         block->is_allocated = false;
  
          if (verbose)
          {
              printf("line %ld: ufree: id %d\n", LINENUM(curr_op), op.index);
          }
  
-         ufree(trace->blocks[op.index].payload);
-         curr_bytes_in_use -= trace->blocks[op.index].block_size;
+         if (sized_free)
+         {
+             ufree_sized(block->payload, block->block_size);
+         }
+         else
+         {
+             ufree(block->payload);
+         }
+         curr_bytes_in_use -= block->block_size;
+         interval_remove(&live_ranges, (uintptr_t)block->payload, op.index);
+         touch(block->payload, block->block_size);
+         release_block(op.index);
      }
  
      if (curr_bytes_in_use > max_bytes_in_use)
      {
          max_bytes_in_use = curr_bytes_in_use;
      }
+     update_heap_bytes();
  
+     /* Sweeps walk the whole heap; other ops get a sample of it */
+     bool sweep = (sweep_interval != 0 && (curr_op + 1) % sweep_interval == 0);
      if (run_check_heap)
      {
-         if (check_heap() != 0)
+         if ((sweep ? check_heap_walk(LINENUM(curr_op)) : check_heap_sample(LINENUM(curr_op))) != 0)
          {
              malloc_error(curr_op, "check heap failed.");
              return -1;
@@ -185,12 +480,17 @@
          }
      }
  
-     if (check_correctness(trace, curr_op) == -1)
+     if ((sweep ? check_correctness(trace, curr_op) : check_touched(trace, curr_op)) == -1)
      {
          printf("line %ld failed the correctness check.\n", LINENUM(curr_op));
          return -1;
      }
  
+     if (verbose)
+     {
+         printf("line %ld passed the correctness check.\n", LINENUM(curr_op));
+     }
+ 
      if (verbose && utilization)
      {
          printf("Current Utilization percentage: %.2f\n", UTILIZATION_SCORE);
@@ -199,9 +499,117 @@
      return 0;
  }
  
+ /*
+  * resident_bytes - Returns the resident set size of the runner, or 0 if
+  * /proc cannot be read.
+  */
+ static size_t resident_bytes(void)
+ {
+     size_t pages = 0, resident = 0;
+     FILE *statm = fopen("/proc/self/statm", "r");
+     if (statm != NULL)
+     {
+         if (fscanf(statm, "%lu %lu", &pages, &resident) != 2)
+         {
+             resident = 0;
+         }
+         fclose(statm);
+     }
+     return resident * PAGESIZE;
+ }
+ 
+ /*
+  * print_footprint - Prints the bytes umalloc holds from sbrk and mmap next
+  * to the runner's resident set size.
+  */
+ static void print_footprint(const char *when)
+ {
+     printf("%s: sbrk %lu bytes, mmap %lu bytes, RSS %lu bytes\n", when, sbrk_bytes, mmap_bytes, resident_bytes());
+ }
+ 
+ /*
+  * print_stats - Prints the allocator's ustats, with a line for every size
+  * class that has blocks handed out or free. The counters are left out when
+  * umalloc was built without them.
+  */
+ static void print_stats(void)
+ {
+     ustats_t stats;
+     ustats(&stats);
+
+     printf("Allocator stats:\n");
+     printf("\theap bytes: %lu, mapped bytes: %lu, free bytes: %lu\n", stats.heap_bytes, stats.mapped_bytes,
+            stats.free_bytes);
+     if (stats.counted)
+     {
+         printf("\tbytes in use: %lu\n", stats.bytes_in_use);
+         printf("\tallocs: %lu, frees: %lu, splits: %lu, coalesces: %lu, extends: %lu\n", stats.allocs,
+                stats.frees, stats.splits, stats.coalesces, stats.extends);
+     }
+     else
+     {
+         printf("\tcounters not built in (make stats to enable them)\n");
+     }
+     printf("\t%5s %10s %10s\n", "class", "live", "free");
+     for (int i = 0; i < BIN_COUNT; ++i)
+     {
+         if (stats.live[i] != 0 || stats.free_blocks[i] != 0)
+         {
+             printf("\t%5d %10lu %10lu\n", i, stats.live[i], stats.free_blocks[i]);
+         }
+     }
+ }
+
+ /*
+  * final_sweep - Checks every allocated block once the last op, curr_op - 1,
+  * has run, since the ops after the last full sweep only checked around
+  * themselves.
+  */
+ static void final_sweep(trace_t *trace, size_t curr_op)
+ {
+     if (curr_op > 0 && check_correctness(trace, curr_op - 1) == -1)
+     {
+         printf("line %ld failed the correctness check.\n", LINENUM(curr_op - 1));
+         printf("umalloc package failed.\n");
+         exit(1);
+     }
+ }
+ 
+ /*
+  * finish_trace - Reports a trace that ran to completion, curr_op ops long,
+  * after a final correctness sweep, with the final utilization and the
+  * heap's footprint before and after a utrim(0) if requested.
+  */
+ static void finish_trace(trace_t *trace, size_t curr_op, int utilization, int run_check_heap)
+ {
+     final_sweep(trace, curr_op);
+     if (run_check_heap && curr_op > 0 && check_heap_walk(LINENUM(curr_op - 1)) != 0)
+     {
+         printf("line %ld failed check heap.\n", LINENUM(curr_op - 1));
+         printf("umalloc package failed.\n");
+         exit(1);
+     }
+     printf("umalloc package passed correctness check.\n");
+ 
+     if (utilization)
+     {
+         printf("Final Utilization percentage: %.2f\n", UTILIZATION_SCORE);
+         print_footprint("Final footprint");
+         size_t released = utrim(0);
+         print_footprint("After utrim");
+         printf("utrim released %lu bytes.\n", released);
+         if (run_check_heap && check_heap() != 0)
+         {
+             printf("check heap failed after utrim.\n");
+             exit(1);
+         }
+     }
+ }
+ 
  /*
   * auto_run_trace - Starting from curr_op, runs the trace to completetion.
-  * Printing the utlilization and running check_heap if requested.
+  * Printing the utlilization and running check_heap if requested. With the
+  * utilization it prints the heap's footprint before and after a utrim(0).
   */
  static int auto_run_trace(trace_t *trace, int utilization, int run_check_heap, size_t curr_op)
  {
@@ -214,20 +622,44 @@
  
      for (; curr_op < trace->num_ops; curr_op++)
      {
-         if (run_trace_line(trace, curr_op, utilization, run_check_heap) == -1)
+         if (run_trace_line(trace, trace->ops[curr_op], curr_op, utilization, run_check_heap) == -1)
          {
              printf("umalloc package failed.\n");
              exit(1);
          }
      }
  
-     printf("umalloc package passed correctness check.\n");
+     finish_trace(trace, curr_op, utilization, run_check_heap);
+     return curr_op;
+ }
  
-     if (utilization)
+ /*
+  * stream_run_trace - Runs a streamed trace to completion as auto_run_trace
+  * does, keeping its blocks in the live map, so traces too large to read
+  * whole can be checked. Closes the stream and frees the map.
+  */
+ static void stream_run_trace(trace_stream_t *stream, int utilization, int run_check_heap)
+ {
+     size_t curr_op = 0;
+     traceop_t *ops;
+     int count;
+ 
+     while ((ops = next_chunk(stream, &count)) != NULL)
      {
-         printf("Final Utilization percentage: %.2f\n", UTILIZATION_SCORE);
+         for (int i = 0; i < count; i++, curr_op++)
+         {
+             if (run_trace_line(NULL, ops[i], curr_op, utilization, run_check_heap) == -1)
+             {
+                 printf("umalloc package failed.\n");
+                 exit(1);
+             }
+         }
      }
-     return curr_op;
+     close_trace_stream(stream);
+ 
+     finish_trace(NULL, curr_op, utilization, run_check_heap);
+     block_map_free(live);
+     live = NULL;
  }
  
  /*
@@ -312,7 +744,7 @@
  
              for (int op = 0; op < ops_to_run; op++)
              {
-                 if (run_trace_line(trace, curr_op, utilization, run_check_heap) == -1)
+                 if (run_trace_line(trace, trace->ops[curr_op], curr_op, utilization, run_check_heap) == -1)
                  {
                      printf("umalloc package failed.\n");
                      exit(1);
@@ -320,6 +752,7 @@
                  curr_op++;
                  if (curr_op == trace->num_ops)
                  {
+                     final_sweep(trace, curr_op);
                      printf("umalloc package passed correctness check.\n");
                      break;
                  }
@@ -339,16 +772,6 @@
      }
  }
  
- int which_bin(mem_block_header_t *bin)
- {
-     for (int i = 0; i < BIN_COUNT; ++i)
-     {
-         if (bin == free_heads[i])
-             return i;
-     }
-     return -1;
- }
- 
  bool uses_bins()
  {
      int counts[BIN_COUNT];
@@ -357,12 +780,6 @@
          counts[i] = 0;
      }
  
-     for (int i = 0; i < BIN_COUNT; ++i)
-     {
-         if (!free_heads[i])
-             free_heads[i] = csbrk(PAGESIZE);
-     }
- 
      const uint64_t test_sizes[] = {
          // Tiny sizes (every 8 bytes from 32 to 512)
          8, 16, 32, 40, 48, 56, 64, 72, 80, 88, 96, 104, 112, 120, 128, 136, 144, 152, 160, 168, 176, 184, 192, 200, 208, 216, 224, 232, 240, 248, 256, 264, 272, 280, 288, 296, 304, 312, 320, 328, 336, 344, 352, 360, 368, 376, 384, 392, 400, 408, 416, 424, 432, 440, 448, 456, 464, 472, 480, 488, 496, 504, 512,
@@ -394,16 +811,18 @@
          16896, 17408, 17920, 18432, 18944, 19456, 19968, 20480, 20992, 21504, 22016, 22528, 23040, 23552, 24064, 24576,
          25088, 25600, 26112, 26624, 27136, 27648, 28160, 28672, 29184, 29696, 30208, 30720, 31232, 31744, 32256, 32768,
          33792, 34816, 35840, 36864, 37888, 38912, 39936, 40960, 41984, 43008, 44032, 45056, 46080, 47104, 48128, 49152,
-         50176, 51200, 52224, 53248, 54272, 55296, 56320, 57344, 58368, 59392, 60416, 61440, 62464, 63488, 64000};
+         50176, 51200, 52224, 53248, 54272, 55296, 56320, 57344, 58368, 59392, 60416, 61440, 62464, 63488, 64000,
+
+         // Past the last class boundary
+         LARGE_CLASS_LIMIT};
  
      const uint64_t size = sizeof(test_sizes) / sizeof(test_sizes[0]);
  
      for (int i = 0; i < size; ++i)
      {
-         mem_block_header_t *bin = select_bin(test_sizes[i]);
-         int index = which_bin(bin);
+         int index = find_bucket(test_sizes[i]);
  
-         if (index == -1)
+         if (index < 0 || index >= BIN_COUNT)
              return false;
  
          counts[index]++;
@@ -413,7 +832,7 @@
      {
          if (counts[i] == 0)
          {
-             printf("Did not use bin #%d, %p\n", i, free_heads[i]);
+             printf("Did not use bin #%d\n", i);
              return false;
          }
      }
@@ -425,12 +844,12 @@
  {
  
      char c;
-     int autorun = 0, run_check_heap = 0, display_utilization = 0;
+     int autorun = 0, run_check_heap = 0, display_utilization = 0, show_stats = 0, streamed = 0;
  
      /*
       * Read and interpret the command line arguments
       */
-     while ((c = getopt(argc, argv, "rvhcu")) != EOF)
+     while ((c = getopt(argc, argv, "rvhcufsSa:i:")) != EOF)
      {
          switch (c)
          {
@@ -449,6 +868,21 @@
          case 'u':
              display_utilization = 1;
              break;
+         case 'f':
+             sized_free = 1;
+             break;
+         case 's':
+             show_stats = 1;
+             break;
+         case 'S':
+             streamed = 1;
+             break;
+         case 'i':
+             sweep_interval = strtoul(optarg, NULL, 0);
+             break;
+         case 'a':
+             alloc_align = strtoul(optarg, NULL, 0);
+             break;
          default:
              usage();
              exit(1);
@@ -490,7 +924,24 @@
          exit(1);
      }
  
-     trace_t *trace = read_trace(file, verbose);
+     if (streamed && !autorun)
+     {
+         usage();
+         appl_error("A streamed trace can only be run with -r.");
+     }
+ 
+     /* Set up before uinit, as read_trace is, so the stream's buffers are not put between heap regions */
+     trace_t *trace = NULL;
+     trace_stream_t *stream = NULL;
+     if (streamed)
+     {
+         stream = open_trace_stream(file, TRACE_CHUNK_OPS);
+         live = block_map_create();
+     }
+     else
+     {
+         trace = read_trace(file, verbose);
+     }
      if (uinit() == -1)
      {
          malloc_error(-3, "uinit failed.");
@@ -498,7 +949,13 @@
      }
      curr_bytes_in_use = 0;
      max_bytes_in_use = 0;
-     if (autorun)
+     max_heap_bytes = 0;
+     update_heap_bytes();
+     if (streamed)
+     {
+         stream_run_trace(stream, display_utilization, run_check_heap);
+     }
+     else if (autorun)
      {
          auto_run_trace(trace, display_utilization, run_check_heap, 0);
      }
@@ -506,7 +963,14 @@
      {
          interactive_run_trace(trace, display_utilization, run_check_heap);
      }
-     free_trace(trace);
+     if (show_stats)
+     {
+         print_stats();
+     }
+     if (trace != NULL)
+     {
+         free_trace(trace);
+     }
      if (!uses_bins())
      {
          printf("Did not use all bins.\n");
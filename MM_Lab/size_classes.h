@@ -0,0 +1,279 @@
+/*
+ * size_classes.h - Generated by gen_classes from 154372 requests in 30 traces.
+ * Regenerate with make classes; do not edit.
+ *
+ * Class lower bounds (block size, header included):
+ *  32 48 64 80 96 112 128 144 160 176
+ *  192 208 224 240 256 272 288 304 320 336
+ *  352 368 384 400 416 432 448 464 480 496
+ *  512 528 544 560 576 592 608 624 640 656
+ *  672 688 704 720 736 752 768 784 800 816
+ *  832 848 864 880 896 912 928 944 960 976
+ *  992 1008 1024 1280 1536 1792 2048 2560 3072 3584
+ *  4032 4096 4224 5120 6144 7168 8192 8448 10240 12288
+ *  14336 16384 20480 24576 28672 32768 40960 49152 57344 65536
+ */
+
+#define EXACT_CLASS_LIMIT 1024UL /* block sizes below this get one class each */
+#define BIN_COUNT 90
+
+/* SIZE_CLASS_LOOKUP[size / ALIGNMENT] is the class of blocks below LARGE_CLASS_LIMIT */
+#define SIZE_CLASS_LOOKUP \
+{ \
+    0,0,0,1,2,3,4,5,6,7,8,9,10,11,12,13, \
+    14,15,16,17,18,19,20,21,22,23,24,25,26,27,28,29, \
+    30,31,32,33,34,35,36,37,38,39,40,41,42,43,44,45, \
+    46,47,48,49,50,51,52,53,54,55,56,57,58,59,60,61, \
+    62,62,62,62,62,62,62,62,62,62,62,62,62,62,62,62, \
+    63,63,63,63,63,63,63,63,63,63,63,63,63,63,63,63, \
+    64,64,64,64,64,64,64,64,64,64,64,64,64,64,64,64, \
+    65,65,65,65,65,65,65,65,65,65,65,65,65,65,65,65, \
+    66,66,66,66,66,66,66,66,66,66,66,66,66,66,66,66, \
+    66,66,66,66,66,66,66,66,66,66,66,66,66,66,66,66, \
+    67,67,67,67,67,67,67,67,67,67,67,67,67,67,67,67, \
+    67,67,67,67,67,67,67,67,67,67,67,67,67,67,67,67, \
+    68,68,68,68,68,68,68,68,68,68,68,68,68,68,68,68, \
+    68,68,68,68,68,68,68,68,68,68,68,68,68,68,68,68, \
+    69,69,69,69,69,69,69,69,69,69,69,69,69,69,69,69, \
+    69,69,69,69,69,69,69,69,69,69,69,69,70,70,70,70, \
+    71,71,71,71,71,71,71,71,72,72,72,72,72,72,72,72, \
+    72,72,72,72,72,72,72,72,72,72,72,72,72,72,72,72, \
+    72,72,72,72,72,72,72,72,72,72,72,72,72,72,72,72, \
+    72,72,72,72,72,72,72,72,72,72,72,72,72,72,72,72, \
+    73,73,73,73,73,73,73,73,73,73,73,73,73,73,73,73, \
+    73,73,73,73,73,73,73,73,73,73,73,73,73,73,73,73, \
+    73,73,73,73,73,73,73,73,73,73,73,73,73,73,73,73, \
+    73,73,73,73,73,73,73,73,73,73,73,73,73,73,73,73, \
+    74,74,74,74,74,74,74,74,74,74,74,74,74,74,74,74, \
+    74,74,74,74,74,74,74,74,74,74,74,74,74,74,74,74, \
+    74,74,74,74,74,74,74,74,74,74,74,74,74,74,74,74, \
+    74,74,74,74,74,74,74,74,74,74,74,74,74,74,74,74, \
+    75,75,75,75,75,75,75,75,75,75,75,75,75,75,75,75, \
+    75,75,75,75,75,75,75,75,75,75,75,75,75,75,75,75, \
+    75,75,75,75,75,75,75,75,75,75,75,75,75,75,75,75, \
+    75,75,75,75,75,75,75,75,75,75,75,75,75,75,75,75, \
+    76,76,76,76,76,76,76,76,76,76,76,76,76,76,76,76, \
+    77,77,77,77,77,77,77,77,77,77,77,77,77,77,77,77, \
+    77,77,77,77,77,77,77,77,77,77,77,77,77,77,77,77, \
+    77,77,77,77,77,77,77,77,77,77,77,77,77,77,77,77, \
+    77,77,77,77,77,77,77,77,77,77,77,77,77,77,77,77, \
+    77,77,77,77,77,77,77,77,77,77,77,77,77,77,77,77, \
+    77,77,77,77,77,77,77,77,77,77,77,77,77,77,77,77, \
+    77,77,77,77,77,77,77,77,77,77,77,77,77,77,77,77, \
+    78,78,78,78,78,78,78,78,78,78,78,78,78,78,78,78, \
+    78,78,78,78,78,78,78,78,78,78,78,78,78,78,78,78, \
+    78,78,78,78,78,78,78,78,78,78,78,78,78,78,78,78, \
+    78,78,78,78,78,78,78,78,78,78,78,78,78,78,78,78, \
+    78,78,78,78,78,78,78,78,78,78,78,78,78,78,78,78, \
+    78,78,78,78,78,78,78,78,78,78,78,78,78,78,78,78, \
+    78,78,78,78,78,78,78,78,78,78,78,78,78,78,78,78, \
+    78,78,78,78,78,78,78,78,78,78,78,78,78,78,78,78, \
+    79,79,79,79,79,79,79,79,79,79,79,79,79,79,79,79, \
+    79,79,79,79,79,79,79,79,79,79,79,79,79,79,79,79, \
+    79,79,79,79,79,79,79,79,79,79,79,79,79,79,79,79, \
+    79,79,79,79,79,79,79,79,79,79,79,79,79,79,79,79, \
+    79,79,79,79,79,79,79,79,79,79,79,79,79,79,79,79, \
+    79,79,79,79,79,79,79,79,79,79,79,79,79,79,79,79, \
+    79,79,79,79,79,79,79,79,79,79,79,79,79,79,79,79, \
+    79,79,79,79,79,79,79,79,79,79,79,79,79,79,79,79, \
+    80,80,80,80,80,80,80,80,80,80,80,80,80,80,80,80, \
+    80,80,80,80,80,80,80,80,80,80,80,80,80,80,80,80, \
+    80,80,80,80,80,80,80,80,80,80,80,80,80,80,80,80, \
+    80,80,80,80,80,80,80,80,80,80,80,80,80,80,80,80, \
+    80,80,80,80,80,80,80,80,80,80,80,80,80,80,80,80, \
+    80,80,80,80,80,80,80,80,80,80,80,80,80,80,80,80, \
+    80,80,80,80,80,80,80,80,80,80,80,80,80,80,80,80, \
+    80,80,80,80,80,80,80,80,80,80,80,80,80,80,80,80, \
+    81,81,81,81,81,81,81,81,81,81,81,81,81,81,81,81, \
+    81,81,81,81,81,81,81,81,81,81,81,81,81,81,81,81, \
+    81,81,81,81,81,81,81,81,81,81,81,81,81,81,81,81, \
+    81,81,81,81,81,81,81,81,81,81,81,81,81,81,81,81, \
+    81,81,81,81,81,81,81,81,81,81,81,81,81,81,81,81, \
+    81,81,81,81,81,81,81,81,81,81,81,81,81,81,81,81, \
+    81,81,81,81,81,81,81,81,81,81,81,81,81,81,81,81, \
+    81,81,81,81,81,81,81,81,81,81,81,81,81,81,81,81, \
+    81,81,81,81,81,81,81,81,81,81,81,81,81,81,81,81, \
+    81,81,81,81,81,81,81,81,81,81,81,81,81,81,81,81, \
+    81,81,81,81,81,81,81,81,81,81,81,81,81,81,81,81, \
+    81,81,81,81,81,81,81,81,81,81,81,81,81,81,81,81, \
+    81,81,81,81,81,81,81,81,81,81,81,81,81,81,81,81, \
+    81,81,81,81,81,81,81,81,81,81,81,81,81,81,81,81, \
+    81,81,81,81,81,81,81,81,81,81,81,81,81,81,81,81, \
+    81,81,81,81,81,81,81,81,81,81,81,81,81,81,81,81, \
+    82,82,82,82,82,82,82,82,82,82,82,82,82,82,82,82, \
+    82,82,82,82,82,82,82,82,82,82,82,82,82,82,82,82, \
+    82,82,82,82,82,82,82,82,82,82,82,82,82,82,82,82, \
+    82,82,82,82,82,82,82,82,82,82,82,82,82,82,82,82, \
+    82,82,82,82,82,82,82,82,82,82,82,82,82,82,82,82, \
+    82,82,82,82,82,82,82,82,82,82,82,82,82,82,82,82, \
+    82,82,82,82,82,82,82,82,82,82,82,82,82,82,82,82, \
+    82,82,82,82,82,82,82,82,82,82,82,82,82,82,82,82, \
+    82,82,82,82,82,82,82,82,82,82,82,82,82,82,82,82, \
+    82,82,82,82,82,82,82,82,82,82,82,82,82,82,82,82, \
+    82,82,82,82,82,82,82,82,82,82,82,82,82,82,82,82, \
+    82,82,82,82,82,82,82,82,82,82,82,82,82,82,82,82, \
+    82,82,82,82,82,82,82,82,82,82,82,82,82,82,82,82, \
+    82,82,82,82,82,82,82,82,82,82,82,82,82,82,82,82, \
+    82,82,82,82,82,82,82,82,82,82,82,82,82,82,82,82, \
+    82,82,82,82,82,82,82,82,82,82,82,82,82,82,82,82, \
+    83,83,83,83,83,83,83,83,83,83,83,83,83,83,83,83, \
+    83,83,83,83,83,83,83,83,83,83,83,83,83,83,83,83, \
+    83,83,83,83,83,83,83,83,83,83,83,83,83,83,83,83, \
+    83,83,83,83,83,83,83,83,83,83,83,83,83,83,83,83, \
+    83,83,83,83,83,83,83,83,83,83,83,83,83,83,83,83, \
+    83,83,83,83,83,83,83,83,83,83,83,83,83,83,83,83, \
+    83,83,83,83,83,83,83,83,83,83,83,83,83,83,83,83, \
+    83,83,83,83,83,83,83,83,83,83,83,83,83,83,83,83, \
+    83,83,83,83,83,83,83,83,83,83,83,83,83,83,83,83, \
+    83,83,83,83,83,83,83,83,83,83,83,83,83,83,83,83, \
+    83,83,83,83,83,83,83,83,83,83,83,83,83,83,83,83, \
+    83,83,83,83,83,83,83,83,83,83,83,83,83,83,83,83, \
+    83,83,83,83,83,83,83,83,83,83,83,83,83,83,83,83, \
+    83,83,83,83,83,83,83,83,83,83,83,83,83,83,83,83, \
+    83,83,83,83,83,83,83,83,83,83,83,83,83,83,83,83, \
+    83,83,83,83,83,83,83,83,83,83,83,83,83,83,83,83, \
+    84,84,84,84,84,84,84,84,84,84,84,84,84,84,84,84, \
+    84,84,84,84,84,84,84,84,84,84,84,84,84,84,84,84, \
+    84,84,84,84,84,84,84,84,84,84,84,84,84,84,84,84, \
+    84,84,84,84,84,84,84,84,84,84,84,84,84,84,84,84, \
+    84,84,84,84,84,84,84,84,84,84,84,84,84,84,84,84, \
+    84,84,84,84,84,84,84,84,84,84,84,84,84,84,84,84, \
+    84,84,84,84,84,84,84,84,84,84,84,84,84,84,84,84, \
+    84,84,84,84,84,84,84,84,84,84,84,84,84,84,84,84, \
+    84,84,84,84,84,84,84,84,84,84,84,84,84,84,84,84, \
+    84,84,84,84,84,84,84,84,84,84,84,84,84,84,84,84, \
+    84,84,84,84,84,84,84,84,84,84,84,84,84,84,84,84, \
+    84,84,84,84,84,84,84,84,84,84,84,84,84,84,84,84, \
+    84,84,84,84,84,84,84,84,84,84,84,84,84,84,84,84, \
+    84,84,84,84,84,84,84,84,84,84,84,84,84,84,84,84, \
+    84,84,84,84,84,84,84,84,84,84,84,84,84,84,84,84, \
+    84,84,84,84,84,84,84,84,84,84,84,84,84,84,84,84, \
+    85,85,85,85,85,85,85,85,85,85,85,85,85,85,85,85, \
+    85,85,85,85,85,85,85,85,85,85,85,85,85,85,85,85, \
+    85,85,85,85,85,85,85,85,85,85,85,85,85,85,85,85, \
+    85,85,85,85,85,85,85,85,85,85,85,85,85,85,85,85, \
+    85,85,85,85,85,85,85,85,85,85,85,85,85,85,85,85, \
+    85,85,85,85,85,85,85,85,85,85,85,85,85,85,85,85, \
+    85,85,85,85,85,85,85,85,85,85,85,85,85,85,85,85, \
+    85,85,85,85,85,85,85,85,85,85,85,85,85,85,85,85, \
+    85,85,85,85,85,85,85,85,85,85,85,85,85,85,85,85, \
+    85,85,85,85,85,85,85,85,85,85,85,85,85,85,85,85, \
+    85,85,85,85,85,85,85,85,85,85,85,85,85,85,85,85, \
+    85,85,85,85,85,85,85,85,85,85,85,85,85,85,85,85, \
+    85,85,85,85,85,85,85,85,85,85,85,85,85,85,85,85, \
+    85,85,85,85,85,85,85,85,85,85,85,85,85,85,85,85, \
+    85,85,85,85,85,85,85,85,85,85,85,85,85,85,85,85, \
+    85,85,85,85,85,85,85,85,85,85,85,85,85,85,85,85, \
+    85,85,85,85,85,85,85,85,85,85,85,85,85,85,85,85, \
+    85,85,85,85,85,85,85,85,85,85,85,85,85,85,85,85, \
+    85,85,85,85,85,85,85,85,85,85,85,85,85,85,85,85, \
+    85,85,85,85,85,85,85,85,85,85,85,85,85,85,85,85, \
+    85,85,85,85,85,85,85,85,85,85,85,85,85,85,85,85, \
+    85,85,85,85,85,85,85,85,85,85,85,85,85,85,85,85, \
+    85,85,85,85,85,85,85,85,85,85,85,85,85,85,85,85, \
+    85,85,85,85,85,85,85,85,85,85,85,85,85,85,85,85, \
+    85,85,85,85,85,85,85,85,85,85,85,85,85,85,85,85, \
+    85,85,85,85,85,85,85,85,85,85,85,85,85,85,85,85, \
+    85,85,85,85,85,85,85,85,85,85,85,85,85,85,85,85, \
+    85,85,85,85,85,85,85,85,85,85,85,85,85,85,85,85, \
+    85,85,85,85,85,85,85,85,85,85,85,85,85,85,85,85, \
+    85,85,85,85,85,85,85,85,85,85,85,85,85,85,85,85, \
+    85,85,85,85,85,85,85,85,85,85,85,85,85,85,85,85, \
+    85,85,85,85,85,85,85,85,85,85,85,85,85,85,85,85, \
+    86,86,86,86,86,86,86,86,86,86,86,86,86,86,86,86, \
+    86,86,86,86,86,86,86,86,86,86,86,86,86,86,86,86, \
+    86,86,86,86,86,86,86,86,86,86,86,86,86,86,86,86, \
+    86,86,86,86,86,86,86,86,86,86,86,86,86,86,86,86, \
+    86,86,86,86,86,86,86,86,86,86,86,86,86,86,86,86, \
+    86,86,86,86,86,86,86,86,86,86,86,86,86,86,86,86, \
+    86,86,86,86,86,86,86,86,86,86,86,86,86,86,86,86, \
+    86,86,86,86,86,86,86,86,86,86,86,86,86,86,86,86, \
+    86,86,86,86,86,86,86,86,86,86,86,86,86,86,86,86, \
+    86,86,86,86,86,86,86,86,86,86,86,86,86,86,86,86, \
+    86,86,86,86,86,86,86,86,86,86,86,86,86,86,86,86, \
+    86,86,86,86,86,86,86,86,86,86,86,86,86,86,86,86, \
+    86,86,86,86,86,86,86,86,86,86,86,86,86,86,86,86, \
+    86,86,86,86,86,86,86,86,86,86,86,86,86,86,86,86, \
+    86,86,86,86,86,86,86,86,86,86,86,86,86,86,86,86, \
+    86,86,86,86,86,86,86,86,86,86,86,86,86,86,86,86, \
+    86,86,86,86,86,86,86,86,86,86,86,86,86,86,86,86, \
+    86,86,86,86,86,86,86,86,86,86,86,86,86,86,86,86, \
+    86,86,86,86,86,86,86,86,86,86,86,86,86,86,86,86, \
+    86,86,86,86,86,86,86,86,86,86,86,86,86,86,86,86, \
+    86,86,86,86,86,86,86,86,86,86,86,86,86,86,86,86, \
+    86,86,86,86,86,86,86,86,86,86,86,86,86,86,86,86, \
+    86,86,86,86,86,86,86,86,86,86,86,86,86,86,86,86, \
+    86,86,86,86,86,86,86,86,86,86,86,86,86,86,86,86, \
+    86,86,86,86,86,86,86,86,86,86,86,86,86,86,86,86, \
+    86,86,86,86,86,86,86,86,86,86,86,86,86,86,86,86, \
+    86,86,86,86,86,86,86,86,86,86,86,86,86,86,86,86, \
+    86,86,86,86,86,86,86,86,86,86,86,86,86,86,86,86, \
+    86,86,86,86,86,86,86,86,86,86,86,86,86,86,86,86, \
+    86,86,86,86,86,86,86,86,86,86,86,86,86,86,86,86, \
+    86,86,86,86,86,86,86,86,86,86,86,86,86,86,86,86, \
+    86,86,86,86,86,86,86,86,86,86,86,86,86,86,86,86, \
+    87,87,87,87,87,87,87,87,87,87,87,87,87,87,87,87, \
+    87,87,87,87,87,87,87,87,87,87,87,87,87,87,87,87, \
+    87,87,87,87,87,87,87,87,87,87,87,87,87,87,87,87, \
+    87,87,87,87,87,87,87,87,87,87,87,87,87,87,87,87, \
+    87,87,87,87,87,87,87,87,87,87,87,87,87,87,87,87, \
+    87,87,87,87,87,87,87,87,87,87,87,87,87,87,87,87, \
+    87,87,87,87,87,87,87,87,87,87,87,87,87,87,87,87, \
+    87,87,87,87,87,87,87,87,87,87,87,87,87,87,87,87, \
+    87,87,87,87,87,87,87,87,87,87,87,87,87,87,87,87, \
+    87,87,87,87,87,87,87,87,87,87,87,87,87,87,87,87, \
+    87,87,87,87,87,87,87,87,87,87,87,87,87,87,87,87, \
+    87,87,87,87,87,87,87,87,87,87,87,87,87,87,87,87, \
+    87,87,87,87,87,87,87,87,87,87,87,87,87,87,87,87, \
+    87,87,87,87,87,87,87,87,87,87,87,87,87,87,87,87, \
+    87,87,87,87,87,87,87,87,87,87,87,87,87,87,87,87, \
+    87,87,87,87,87,87,87,87,87,87,87,87,87,87,87,87, \
+    87,87,87,87,87,87,87,87,87,87,87,87,87,87,87,87, \
+    87,87,87,87,87,87,87,87,87,87,87,87,87,87,87,87, \
+    87,87,87,87,87,87,87,87,87,87,87,87,87,87,87,87, \
+    87,87,87,87,87,87,87,87,87,87,87,87,87,87,87,87, \
+    87,87,87,87,87,87,87,87,87,87,87,87,87,87,87,87, \
+    87,87,87,87,87,87,87,87,87,87,87,87,87,87,87,87, \
+    87,87,87,87,87,87,87,87,87,87,87,87,87,87,87,87, \
+    87,87,87,87,87,87,87,87,87,87,87,87,87,87,87,87, \
+    87,87,87,87,87,87,87,87,87,87,87,87,87,87,87,87, \
+    87,87,87,87,87,87,87,87,87,87,87,87,87,87,87,87, \
+    87,87,87,87,87,87,87,87,87,87,87,87,87,87,87,87, \
+    87,87,87,87,87,87,87,87,87,87,87,87,87,87,87,87, \
+    87,87,87,87,87,87,87,87,87,87,87,87,87,87,87,87, \
+    87,87,87,87,87,87,87,87,87,87,87,87,87,87,87,87, \
+    87,87,87,87,87,87,87,87,87,87,87,87,87,87,87,87, \
+    87,87,87,87,87,87,87,87,87,87,87,87,87,87,87,87, \
+    88,88,88,88,88,88,88,88,88,88,88,88,88,88,88,88, \
+    88,88,88,88,88,88,88,88,88,88,88,88,88,88,88,88, \
+    88,88,88,88,88,88,88,88,88,88,88,88,88,88,88,88, \
+    88,88,88,88,88,88,88,88,88,88,88,88,88,88,88,88, \
+    88,88,88,88,88,88,88,88,88,88,88,88,88,88,88,88, \
+    88,88,88,88,88,88,88,88,88,88,88,88,88,88,88,88, \
+    88,88,88,88,88,88,88,88,88,88,88,88,88,88,88,88, \
+    88,88,88,88,88,88,88,88,88,88,88,88,88,88,88,88, \
+    88,88,88,88,88,88,88,88,88,88,88,88,88,88,88,88, \
+    88,88,88,88,88,88,88,88,88,88,88,88,88,88,88,88, \
+    88,88,88,88,88,88,88,88,88,88,88,88,88,88,88,88, \
+    88,88,88,88,88,88,88,88,88,88,88,88,88,88,88,88, \
+    88,88,88,88,88,88,88,88,88,88,88,88,88,88,88,88, \
+    88,88,88,88,88,88,88,88,88,88,88,88,88,88,88,88, \
+    88,88,88,88,88,88,88,88,88,88,88,88,88,88,88,88, \
+    88,88,88,88,88,88,88,88,88,88,88,88,88,88,88,88, \
+    88,88,88,88,88,88,88,88,88,88,88,88,88,88,88,88, \
+    88,88,88,88,88,88,88,88,88,88,88,88,88,88,88,88, \
+    88,88,88,88,88,88,88,88,88,88,88,88,88,88,88,88, \
+    88,88,88,88,88,88,88,88,88,88,88,88,88,88,88,88, \
+    88,88,88,88,88,88,88,88,88,88,88,88,88,88,88,88, \
+    88,88,88,88,88,88,88,88,88,88,88,88,88,88,88,88, \
+    88,88,88,88,88,88,88,88,88,88,88,88,88,88,88,88, \
+    88,88,88,88,88,88,88,88,88,88,88,88,88,88,88,88, \
+    88,88,88,88,88,88,88,88,88,88,88,88,88,88,88,88, \
+    88,88,88,88,88,88,88,88,88,88,88,88,88,88,88,88, \
+    88,88,88,88,88,88,88,88,88,88,88,88,88,88,88,88, \
+    88,88,88,88,88,88,88,88,88,88,88,88,88,88,88,88, \
+    88,88,88,88,88,88,88,88,88,88,88,88,88,88,88,88, \
+    88,88,88,88,88,88,88,88,88,88,88,88,88,88,88,88, \
+    88,88,88,88,88,88,88,88,88,88,88,88,88,88,88,88, \
+    88,88,88,88,88,88,88,88,88,88,88,88,88,88,88,88, \
+}
@@ -9,6 +9,7 @@
 
 #include "support.h"
 #include "err_handler.h"
+#include <limits.h>
 
 char msg[MAXLINE];
 /* 
@@ -33,13 +34,137 @@ void malloc_error(int opnum, char *msg)
 }
 
 /*
- * read_trace - read a trace file and store it in memory
+ * check_binary_op - reject an op of a binary trace that names an unknown
+ *                   type or ids outside 0..num_ids-1, since the records
+ *                   are used without being parsed.
+ */
+static void check_binary_op(traceop_t *op, int num_ids, char *filename)
+{
+    bool batch = (op->type == BATCH_ALLOC || op->type == BATCH_FREE);
+    int count = batch ? op->count : 1;
+
+    if ((int) op->type < ALLOC || (int) op->type > BATCH_FREE || op->index < 0 || op->size < 0 || count < 1
+        || count > num_ids - op->index) {
+        sprintf(msg, "Malformed op in binary trace %s", filename);
+        appl_error(msg);
+    }
+}
+
+/*
+ * map_trace - map a binary trace file, whose ops are used where they lie.
+ *             The file must hold exactly the ops its header declares, and
+ *             each is checked once, so a truncated or corrupt file is an
+ *             error rather than an out of bounds read.
+ */
+static void map_trace(trace_t *trace, int fd, char *filename)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < sizeof(trace_header_t)) {
+        sprintf(msg, "Could not read the header of %s in read_trace", filename);
+        appl_error(msg);
+    }
+
+    /* Private and writable, so a caller that edits an op gets its own copy */
+    void *mapping = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED)
+        appl_error("mmap failed in read_trace");
+
+    trace_header_t *header = mapping;
+    if (header->record_size != sizeof(traceop_t) || header->num_ops < 0 || header->num_ids < 0
+        || st.st_size != sizeof(trace_header_t) + (size_t) header->num_ops * sizeof(traceop_t)) {
+        sprintf(msg, "Malformed binary trace %s", filename);
+        appl_error(msg);
+    }
+    traceop_t *ops = (traceop_t *) (header + 1);
+    for (int i = 0; i < header->num_ops; i++)
+        check_binary_op(&ops[i], header->num_ids, filename);
+
+    trace->num_ids = header->num_ids;
+    trace->num_ops = header->num_ops;
+    trace->ops = ops;
+    trace->mapping = mapping;
+    trace->mapping_size = st.st_size;
+    trace->blocks = (allocated_block_t *)calloc(trace->num_ids, sizeof(allocated_block_t));
+    if (trace->blocks == NULL)
+        appl_error("Failed to allocate block array");
+}
+
+/*
+ * read_op - read the next request line of a text trace into op. Returns 0
+ *           at the end of the file.
+ */
+static int read_op(FILE *tracefile, traceop_t *op, char *filename)
+{
+    char type[MAXLINE];
+    unsigned index = 0;
+    unsigned size = 0;
+    unsigned count = 0;
+    int err;
+
+    if (fscanf(tracefile, "%s", type) == EOF)
+        return 0;
+    memset(op, 0, sizeof(*op));
+    switch(type[0]) {
+    case 'a':
+        err = fscanf(tracefile, "%u %u", &index, &size);
+        if (err == EOF) {
+            appl_error("fscanf failed to find index and size.");
+        }
+        op->type = ALLOC;
+        op->index = index;
+        op->size = size;
+        break;
+    case 'r':
+        err = fscanf(tracefile, "%u %u", &index, &size);
+        if (err == EOF) {
+            appl_error("fscanf failed to find index and size.");
+        }
+        op->type = REALLOC;
+        op->index = index;
+        op->size = size;
+        break;
+    case 'A':
+        err = fscanf(tracefile, "%u %u %u", &index, &count, &size);
+        if (err == EOF || count == 0) {
+            appl_error("fscanf failed to find index, count and size.");
+        }
+        op->type = BATCH_ALLOC;
+        op->index = index;
+        op->count = count;
+        op->size = size;
+        break;
+    case 'F':
+        err = fscanf(tracefile, "%u %u", &index, &count);
+        if (err == EOF || count == 0) {
+            appl_error("fscanf failed to find index and count.");
+        }
+        op->type = BATCH_FREE;
+        op->index = index;
+        op->count = count;
+        break;
+    case 'f':
+        err = fscanf(tracefile, "%ud", &index);
+        if (err == EOF) {
+            appl_error("fscanf failed to find index.");
+        }
+        op->type = FREE;
+        op->index = index;
+    break;
+    default:
+        sprintf(msg, "Bogus type character (%c) in tracefile %s\n", type[0], filename);
+        appl_error(msg);
+    }
+    return 1;
+}
+
+/*
+ * read_trace - read a trace file and store it in memory. Binary traces
+ *              (see trace_header_t) are mapped instead of parsed.
  */
 trace_t *read_trace(char *filename, int verbose)
 {
     FILE *tracefile;
     trace_t *trace;
-    char type[MAXLINE];
     int err;
 
     if (verbose)
@@ -48,6 +173,8 @@ trace_t *read_trace(char *filename, int verbose)
     /* Allocate the trace record */
     if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
         appl_error("malloc 1 failed in read_trace");
+    trace->mapping = NULL;
+    trace->mapping_size = 0;
 
     /* Read the trace file header */
     if ((tracefile = fopen(filename, "r")) == NULL) {
@@ -55,6 +182,20 @@ trace_t *read_trace(char *filename, int verbose)
         appl_error(msg);
     }
 
+    char magic[sizeof(TRACE_MAGIC) - 1];
+    if (fread(magic, 1, sizeof(magic), tracefile) == sizeof(magic)
+        && memcmp(magic, TRACE_MAGIC, sizeof(magic)) == 0) {
+        map_trace(trace, fileno(tracefile), filename);
+        fclose(tracefile);
+        return trace;
+    }
+    if (memcmp(magic, CAPTURE_MAGIC, sizeof(magic)) == 0) {
+        fclose(tracefile);
+        free(trace);
+        return read_capture(filename, -1);
+    }
+    rewind(tracefile);
+
     err = fscanf(tracefile, "%d", &(trace->num_ids)); 
     if (err == EOF) {
         appl_error("fscanf failed to find num ids.");
@@ -77,41 +218,230 @@ trace_t *read_trace(char *filename, int verbose)
 
     
     /* read every request line in the trace file */
-    unsigned index = 0;
     unsigned op_index = 0;
     unsigned max_index = 0;
-    unsigned size = 0;
-    while (fscanf(tracefile, "%s", type) != EOF) {
-        switch(type[0]) {
-        case 'a':
-            err = fscanf(tracefile, "%u %u", &index, &size);
-            if (err == EOF) {
-                appl_error("fscanf failed to find index and size.");
-            }
-            trace->ops[op_index].type = ALLOC;
-            trace->ops[op_index].index = index;
-            trace->ops[op_index].size = size;
-            max_index = (index > max_index) ? index : max_index;
+    while (read_op(tracefile, &trace->ops[op_index], filename)) {
+        traceop_t op = trace->ops[op_index];
+        if (op.type == BATCH_ALLOC)
+            max_index = (op.index + op.count - 1 > max_index) ? op.index + op.count - 1 : max_index;
+        else if (op.type == ALLOC || op.type == REALLOC)
+            max_index = (op.index > max_index) ? op.index : max_index;
+        op_index++;
+    }
+    fclose(tracefile);
+    assert(max_index == trace->num_ids - 1);
+    assert(trace->num_ops == op_index);
+
+    return trace;
+}
+
+/* The ids of a capture's live blocks by address, open addressed like block_map_t */
+typedef struct {
+    uint64_t *ptrs;           /* 0 in unused slots */
+    int *ids;
+    size_t capacity;          /* a power of two */
+    size_t count;
+} ptr_map_t;
+
+/*
+ * ptr_map_home - return the slot ptr hashes to.
+ */
+static size_t ptr_map_home(ptr_map_t *map, uint64_t ptr)
+{
+    return ((ptr >> 4) * 0x9E3779B97F4A7C15UL >> 32) & (map->capacity - 1);
+}
+
+/*
+ * ptr_map_slot - return the slot holding ptr, or the empty slot it would
+ *                go in.
+ */
+static size_t ptr_map_slot(ptr_map_t *map, uint64_t ptr)
+{
+    size_t slot = ptr_map_home(map, ptr);
+    while (map->ptrs[slot] != 0 && map->ptrs[slot] != ptr)
+        slot = (slot + 1) & (map->capacity - 1);
+    return slot;
+}
+
+/*
+ * ptr_map_put - record that the block at ptr, which is not in the map, has
+ *               id, doubling the table once it is half full.
+ */
+static void ptr_map_put(ptr_map_t *map, uint64_t ptr, int id)
+{
+    if (2 * (map->count + 1) > map->capacity) {
+        ptr_map_t old = *map;
+        map->capacity = (old.capacity == 0) ? 1024 : 2 * old.capacity;
+        map->ptrs = (uint64_t *) calloc(map->capacity, sizeof(uint64_t));
+        map->ids = (int *) malloc(map->capacity * sizeof(int));
+        if (map->ptrs == NULL || map->ids == NULL)
+            appl_error("Failed to grow the block table in read_capture");
+        map->count = 0;
+        for (size_t i = 0; i < old.capacity; i++)
+            if (old.ptrs[i] != 0)
+                ptr_map_put(map, old.ptrs[i], old.ids[i]);
+        free(old.ptrs);
+        free(old.ids);
+    }
+    size_t slot = ptr_map_slot(map, ptr);
+    map->ptrs[slot] = ptr;
+    map->ids[slot] = id;
+    map->count++;
+}
+
+/*
+ * ptr_map_take - remove ptr from the map and return its id, or -1 if it
+ *                was not there. The entries after it move back into the
+ *                gap, as in block_map_remove.
+ */
+static int ptr_map_take(ptr_map_t *map, uint64_t ptr)
+{
+    if (map->capacity == 0 || ptr == 0)
+        return -1;
+    size_t slot = ptr_map_slot(map, ptr);
+    if (map->ptrs[slot] == 0)
+        return -1;
+    int id = map->ids[slot];
+
+    size_t mask = map->capacity - 1;
+    for (size_t next = (slot + 1) & mask; map->ptrs[next] != 0; next = (next + 1) & mask) {
+        size_t home = ptr_map_home(map, map->ptrs[next]);
+        /* An entry moves back unless its home lies in (slot, next] */
+        if (((next - home) & mask) >= ((next - slot) & mask)) {
+            map->ptrs[slot] = map->ptrs[next];
+            map->ids[slot] = map->ids[next];
+            slot = next;
+        }
+    }
+    map->ptrs[slot] = 0;
+    map->count--;
+    return id;
+}
+
+/* A capture record's place in time, for putting the records in order */
+struct capture_order {
+    uint64_t time;
+    size_t index;
+};
+
+static int compare_capture_order(const void *a, const void *b)
+{
+    const struct capture_order *x = a, *y = b;
+    if (x->time != y->time)
+        return (x->time > y->time) - (x->time < y->time);
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+/*
+ * capture_alloc - append an alloc of size bytes for the block at ptr with a
+ *                 new id, first freeing the id of an earlier block there
+ *                 whose free the capture missed. Returns the op count.
+ */
+static int capture_alloc(trace_t *trace, ptr_map_t *live, int num_ops, uint64_t ptr, uint64_t size)
+{
+    int stale = ptr_map_take(live, ptr);
+    if (stale >= 0)
+        trace->ops[num_ops++] = (traceop_t) {.type = FREE, .index = stale};
+    trace->ops[num_ops++] = (traceop_t) {.type = ALLOC, .index = trace->num_ids, .size = size};
+    ptr_map_put(live, ptr, trace->num_ids++);
+    return num_ops;
+}
+
+/*
+ * read_capture - turn a capture capture.so wrote into a trace, keeping only
+ *                the calls of kernel thread id thread, or every call if
+ *                thread is -1. Calls are replayed in the order they
+ *                returned. Every block gets an id of its own that a realloc
+ *                passes on to the block it returns; calls on blocks the
+ *                capture never saw allocated, failed calls and requests
+ *                too large for a trace are left out.
+ */
+trace_t *read_capture(char *filename, long thread)
+{
+    int fd = open(filename, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size < sizeof(capture_header_t)) {
+        sprintf(msg, "Could not read the header of %s in read_capture", filename);
+        appl_error(msg);
+    }
+    void *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        appl_error("mmap failed in read_capture");
+
+    capture_header_t *header = mapping;
+    if (memcmp(header->magic, CAPTURE_MAGIC, sizeof(header->magic)) != 0
+        || header->record_size != sizeof(capture_record_t)) {
+        sprintf(msg, "Malformed capture %s", filename);
+        appl_error(msg);
+    }
+    capture_record_t *records = (capture_record_t *) (header + 1);
+    size_t num_records = (st.st_size - sizeof(capture_header_t)) / sizeof(capture_record_t);
+    if (num_records > INT32_MAX / 2)
+        appl_error("Capture too long for a trace in read_capture");
+
+    struct capture_order *order = (struct capture_order *) malloc((num_records + 1) * sizeof(*order));
+    trace_t *trace = (trace_t *) calloc(1, sizeof(trace_t));
+    if (order == NULL || trace == NULL
+        || (trace->ops = (traceop_t *) malloc((2 * num_records + 1) * sizeof(traceop_t))) == NULL)
+        appl_error("Failed to allocate op array");
+    for (size_t i = 0; i < num_records; i++)
+        order[i] = (struct capture_order) {records[i].time, i};
+    qsort(order, num_records, sizeof(*order), compare_capture_order);
+
+    ptr_map_t live = {0};
+    int num_ops = 0;
+    for (size_t i = 0; i < num_records; i++) {
+        capture_record_t *record = &records[order[i].index];
+        if (thread >= 0 && record->thread != thread)
+            continue;
+        bool fits = record->size <= INT_MAX;
+
+        switch (record->op) {
+        case CAPTURE_MALLOC:
+        case CAPTURE_CALLOC:
+            if (record->ptr != 0 && fits)
+                num_ops = capture_alloc(trace, &live, num_ops, record->ptr, record->size);
+            break;
+        case CAPTURE_FREE: {
+            int id = ptr_map_take(&live, record->ptr);
+            if (id >= 0)
+                trace->ops[num_ops++] = (traceop_t) {.type = FREE, .index = id};
             break;
-        case 'f':
-            err = fscanf(tracefile, "%ud", &index);
-            if (err == EOF) {
-                appl_error("fscanf failed to find index.");
+        }
+        case CAPTURE_REALLOC: {
+            if (record->ptr == 0 && record->size != 0)
+                break; /* failed, and the old block is untouched */
+            int id = ptr_map_take(&live, record->old);
+            if (record->ptr == 0 || id < 0 || !fits) {
+                /* a free, a block the capture missed, or a size no trace holds */
+                if (id >= 0)
+                    trace->ops[num_ops++] = (traceop_t) {.type = FREE, .index = id};
+                if (record->ptr != 0 && fits)
+                    num_ops = capture_alloc(trace, &live, num_ops, record->ptr, record->size);
+                break;
             }
-            trace->ops[op_index].type = FREE;
-            trace->ops[op_index].index = index;
-        break;
+            int stale = ptr_map_take(&live, record->ptr);
+            if (stale >= 0)
+                trace->ops[num_ops++] = (traceop_t) {.type = FREE, .index = stale};
+            trace->ops[num_ops++] = (traceop_t) {.type = REALLOC, .index = id, .size = record->size};
+            ptr_map_put(&live, record->ptr, id);
+            break;
+        }
         default:
-            sprintf(msg, "Bogus type character (%c) in tracefile %s\n", type[0], filename);
+            sprintf(msg, "Bogus call type (%u) in capture %s", record->op, filename);
             appl_error(msg);
         }
-        op_index++;
-
     }
-    fclose(tracefile);
-    assert(max_index == trace->num_ids - 1);
-    assert(trace->num_ops == op_index);
 
+    trace->num_ops = num_ops;
+    trace->blocks = (allocated_block_t *) calloc(trace->num_ids + 1, sizeof(allocated_block_t));
+    if (trace->blocks == NULL)
+        appl_error("Failed to allocate block array");
+    free(live.ptrs);
+    free(live.ids);
+    free(order);
+    munmap(mapping, st.st_size);
     return trace;
 }
 
@@ -121,7 +451,378 @@ trace_t *read_trace(char *filename, int verbose)
  */
 void free_trace(trace_t *trace)
 {
-    free(trace->ops);         /* free the two arrays... */
+    if (trace->mapping != NULL)
+        munmap(trace->mapping, trace->mapping_size);
+    else
+        free(trace->ops);     /* free the two arrays... */
     free(trace->blocks);      
     free(trace);              /* and the trace record itself... */
 }
+
+/*
+ * write_trace - write a trace to filename, as a binary trace if binary is
+ *               set and in the text format read_trace parses otherwise.
+ */
+void write_trace(trace_t *trace, char *filename, int binary)
+{
+    FILE *tracefile;
+
+    if ((tracefile = fopen(filename, "w")) == NULL) {
+        sprintf(msg, "Could not open %s in write_trace", filename);
+        appl_error(msg);
+    }
+
+    if (binary) {
+        trace_header_t header = {.record_size = sizeof(traceop_t), .num_ids = trace->num_ids,
+                                 .num_ops = trace->num_ops, .reserved = 0};
+        memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+        if (fwrite(&header, sizeof(header), 1, tracefile) != 1
+            || fwrite(trace->ops, sizeof(traceop_t), trace->num_ops, tracefile) != trace->num_ops)
+            appl_error("fwrite failed in write_trace");
+    } else {
+        fprintf(tracefile, "%d\n%d\n", trace->num_ids, trace->num_ops);
+        for (int i = 0; i < trace->num_ops; i++) {
+            traceop_t op = trace->ops[i];
+            switch (op.type) {
+            case ALLOC:
+                fprintf(tracefile, "a %d %d\n", op.index, op.size);
+                break;
+            case REALLOC:
+                fprintf(tracefile, "r %d %d\n", op.index, op.size);
+                break;
+            case BATCH_ALLOC:
+                fprintf(tracefile, "A %d %d %d\n", op.index, op.count, op.size);
+                break;
+            case BATCH_FREE:
+                fprintf(tracefile, "F %d %d\n", op.index, op.count);
+                break;
+            case FREE:
+                fprintf(tracefile, "f %d\n", op.index);
+                break;
+            }
+        }
+    }
+
+    if (fclose(tracefile) != 0)
+        appl_error("fclose failed in write_trace");
+}
+
+/*
+ * trace_leftovers - Stores the ids the trace leaves allocated at its end in
+ *                   ids, which must have room for num_ids of them, and
+ *                   returns how many there are.
+ */
+int trace_leftovers(trace_t *trace, int *ids)
+{
+    bool *live = calloc(trace->num_ids, sizeof(bool));
+    if (live == NULL)
+        appl_error("calloc failed in trace_leftovers");
+
+    for (int i = 0; i < trace->num_ops; i++) {
+        traceop_t op = trace->ops[i];
+        int count = (op.type == BATCH_ALLOC || op.type == BATCH_FREE) ? op.count : 1;
+        for (int j = 0; j < count; j++)
+            live[op.index + j] = (op.type != FREE && op.type != BATCH_FREE);
+    }
+
+    int num_ids = 0;
+    for (int id = 0; id < trace->num_ids; id++) {
+        if (live[id])
+            ids[num_ids++] = id;
+    }
+    free(live);
+    return num_ids;
+}
+
+/*
+ * fill_chunk - read up to chunk_ops ops of the stream into ops and return
+ *              how many were read, 0 at the end of the trace.
+ */
+static int fill_chunk(trace_stream_t *stream, traceop_t *ops)
+{
+    int count = 0;
+
+    if (stream->binary) {
+        int want = (stream->ops_left < stream->chunk_ops) ? stream->ops_left : stream->chunk_ops;
+        count = fread(ops, sizeof(traceop_t), want, stream->file);
+        if (count != want) {
+            sprintf(msg, "Binary trace %s ends early", stream->filename);
+            appl_error(msg);
+        }
+        for (int i = 0; i < count; i++)
+            check_binary_op(&ops[i], stream->num_ids, stream->filename);
+        stream->ops_left -= count;
+        return count;
+    }
+    while (count < stream->chunk_ops && read_op(stream->file, &ops[count], stream->filename))
+        count++;
+    return count;
+}
+
+/*
+ * stream_reader - the reader thread of a stream. Fills the buffers in turn,
+ *                 each as soon as the caller hands it back, until the trace
+ *                 ends or the stream is closed.
+ */
+static void *stream_reader(void *arg)
+{
+    trace_stream_t *stream = arg;
+
+    for (int slot = 0; ; slot ^= 1) {
+        pthread_mutex_lock(&stream->lock);
+        while (stream->counts[slot] != -1 && !stream->stop)
+            pthread_cond_wait(&stream->changed, &stream->lock);
+        bool stop = stream->stop;
+        pthread_mutex_unlock(&stream->lock);
+        if (stop)
+            return NULL;
+
+        int count = fill_chunk(stream, stream->buffers[slot]);
+        pthread_mutex_lock(&stream->lock);
+        stream->counts[slot] = count;
+        pthread_cond_broadcast(&stream->changed);
+        pthread_mutex_unlock(&stream->lock);
+        if (count == 0)
+            return NULL;
+    }
+}
+
+/*
+ * open_trace_stream - open a trace file for reading chunk_ops ops at a time
+ *                     with next_chunk and start reading ahead.
+ */
+trace_stream_t *open_trace_stream(char *filename, int chunk_ops)
+{
+    trace_stream_t *stream;
+
+    if ((stream = (trace_stream_t *) calloc(1, sizeof(trace_stream_t))) == NULL)
+        appl_error("malloc failed in open_trace_stream");
+    if ((stream->file = fopen(filename, "r")) == NULL) {
+        sprintf(msg, "Could not open %s in open_trace_stream", filename);
+        appl_error(msg);
+    }
+    stream->filename = filename;
+
+    trace_header_t header;
+    if (fread(&header, sizeof(header), 1, stream->file) == 1
+        && memcmp(header.magic, CAPTURE_MAGIC, sizeof(header.magic)) == 0) {
+        sprintf(msg, "%s is a capture; convert it with convert_trace to stream it", filename);
+        appl_error(msg);
+    }
+    if (memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) == 0) {
+        if (header.record_size != sizeof(traceop_t) || header.num_ops < 0 || header.num_ids < 0) {
+            sprintf(msg, "Malformed binary trace %s", filename);
+            appl_error(msg);
+        }
+        stream->binary = true;
+        stream->num_ids = header.num_ids;
+        stream->num_ops = header.num_ops;
+        stream->ops_left = header.num_ops;
+    } else {
+        rewind(stream->file);
+        if (fscanf(stream->file, "%d", &stream->num_ids) == EOF)
+            appl_error("fscanf failed to find num ids.");
+        if (fscanf(stream->file, "%d", &stream->num_ops) == EOF)
+            appl_error("fscanf failed to find num ops.");
+    }
+
+    stream->chunk_ops = chunk_ops;
+    for (int i = 0; i < 2; i++) {
+        if ((stream->buffers[i] = (traceop_t *) calloc(chunk_ops, sizeof(traceop_t))) == NULL)
+            appl_error("Failed to allocate stream buffers");
+        stream->counts[i] = -1;
+    }
+    pthread_mutex_init(&stream->lock, NULL);
+    pthread_cond_init(&stream->changed, NULL);
+    if (pthread_create(&stream->reader, NULL, stream_reader, stream) != 0)
+        appl_error("Failed to start the trace reader");
+    return stream;
+}
+
+/*
+ * next_chunk - hand the chunk returned last back to the reader and return
+ *              the next one, with its length in count, waiting for it if it
+ *              is still being read. Returns NULL at the end of the trace.
+ */
+traceop_t *next_chunk(trace_stream_t *stream, int *count)
+{
+    pthread_mutex_lock(&stream->lock);
+    if (stream->held) {
+        stream->counts[stream->next ^ 1] = -1;
+        stream->held = false;
+        pthread_cond_broadcast(&stream->changed);
+    }
+    while (stream->counts[stream->next] == -1)
+        pthread_cond_wait(&stream->changed, &stream->lock);
+
+    int slot = stream->next;
+    *count = stream->counts[slot];
+    if (*count > 0) {
+        stream->next ^= 1;
+        stream->held = true;
+    }
+    pthread_mutex_unlock(&stream->lock);
+    return (*count > 0) ? stream->buffers[slot] : NULL;
+}
+
+/*
+ * close_trace_stream - stop the reader and free the stream, whether or not
+ *                      it was read to the end.
+ */
+void close_trace_stream(trace_stream_t *stream)
+{
+    pthread_mutex_lock(&stream->lock);
+    stream->stop = true;
+    pthread_cond_broadcast(&stream->changed);
+    pthread_mutex_unlock(&stream->lock);
+    pthread_join(stream->reader, NULL);
+
+    pthread_mutex_destroy(&stream->lock);
+    pthread_cond_destroy(&stream->changed);
+    fclose(stream->file);
+    free(stream->buffers[0]);
+    free(stream->buffers[1]);
+    free(stream);
+}
+
+/*
+ * map_memory - return size bytes of zeroed memory straight from mmap. The
+ *              runner keeps its own bookkeeping here, since malloc can move
+ *              the program break that csbrk grows umalloc's heap from and
+ *              so change how contiguous the heap is.
+ */
+void *map_memory(size_t size)
+{
+    void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+        appl_error("mmap failed in map_memory");
+    return memory;
+}
+
+/*
+ * unmap_memory - give back size bytes from map_memory.
+ */
+void unmap_memory(void *memory, size_t size)
+{
+    munmap(memory, size);
+}
+
+#define BLOCK_MAP_MIN 1024 /* initial slots of a block map */
+
+/*
+ * block_map_home - return the slot id hashes to.
+ */
+static size_t block_map_home(block_map_t *map, int id)
+{
+    return ((uint32_t) id * 0x9E3779B97F4A7C15UL >> 32) & (map->capacity - 1);
+}
+
+/*
+ * block_map_slot - return the slot holding id, or the empty slot it would
+ *                  go in.
+ */
+static size_t block_map_slot(block_map_t *map, int id)
+{
+    size_t mask = map->capacity - 1;
+    size_t slot = block_map_home(map, id);
+
+    while (map->ids[slot] != id && map->ids[slot] != BLOCK_MAP_EMPTY)
+        slot = (slot + 1) & mask;
+    return slot;
+}
+
+/*
+ * block_map_resize - move every entry of the map into capacity slots.
+ */
+static void block_map_resize(block_map_t *map, size_t capacity)
+{
+    int *ids = map->ids;
+    allocated_block_t *blocks = map->blocks;
+    size_t old_capacity = map->capacity;
+
+    map->ids = (int *) map_memory(capacity * sizeof(int));
+    map->blocks = (allocated_block_t *) map_memory(capacity * sizeof(allocated_block_t));
+    memset(map->ids, 0xff, capacity * sizeof(int)); /* BLOCK_MAP_EMPTY */
+    map->capacity = capacity;
+
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (ids[i] != BLOCK_MAP_EMPTY) {
+            size_t slot = block_map_slot(map, ids[i]);
+            map->ids[slot] = ids[i];
+            map->blocks[slot] = blocks[i];
+        }
+    }
+    if (old_capacity != 0) {
+        unmap_memory(ids, old_capacity * sizeof(int));
+        unmap_memory(blocks, old_capacity * sizeof(allocated_block_t));
+    }
+}
+
+/*
+ * block_map_create - return an empty block map.
+ */
+block_map_t *block_map_create(void)
+{
+    block_map_t *map = (block_map_t *) calloc(1, sizeof(block_map_t));
+    if (map == NULL)
+        appl_error("malloc failed in block_map_create");
+    block_map_resize(map, BLOCK_MAP_MIN);
+    return map;
+}
+
+/*
+ * block_map_get - return the block of id, adding a zeroed one if id has
+ *                 none. The map grows at half full.
+ */
+allocated_block_t *block_map_get(block_map_t *map, int id)
+{
+    if (id < 0)
+        appl_error("Negative block id in block_map_get");
+
+    size_t slot = block_map_slot(map, id);
+    if (map->ids[slot] == id)
+        return &map->blocks[slot];
+
+    if (2 * (map->count + 1) > map->capacity) {
+        block_map_resize(map, 2 * map->capacity);
+        slot = block_map_slot(map, id);
+    }
+    map->ids[slot] = id;
+    map->count++;
+    return &map->blocks[slot];
+}
+
+/*
+ * block_map_remove - drop id from the map, shifting back the entries that
+ *                    probed past its slot so no tombstones are left.
+ */
+void block_map_remove(block_map_t *map, int id)
+{
+    size_t mask = map->capacity - 1;
+    size_t slot = block_map_slot(map, id);
+
+    if (map->ids[slot] == BLOCK_MAP_EMPTY)
+        return;
+    map->count--;
+    for (size_t next = (slot + 1) & mask; map->ids[next] != BLOCK_MAP_EMPTY; next = (next + 1) & mask) {
+        size_t home = block_map_home(map, map->ids[next]);
+        /* The entry at next may fill the hole at slot unless its home lies after slot */
+        if (((next - home) & mask) >= ((next - slot) & mask)) {
+            map->ids[slot] = map->ids[next];
+            map->blocks[slot] = map->blocks[next];
+            slot = next;
+        }
+    }
+    map->ids[slot] = BLOCK_MAP_EMPTY;
+    memset(&map->blocks[slot], 0, sizeof(allocated_block_t));
+}
+
+/*
+ * block_map_free - free the map and its tables.
+ */
+void block_map_free(block_map_t *map)
+{
+    unmap_memory(map->ids, map->capacity * sizeof(int));
+    unmap_memory(map->blocks, map->capacity * sizeof(allocated_block_t));
+    free(map);
+}
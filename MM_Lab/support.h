@@ -17,6 +17,10 @@
 #include <assert.h>
 #include <float.h>
 #include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <pthread.h>
 
 #define MAXLINE     1024 /* max string size */
 #define HDRLINES       2 /* number of header lines in a trace file */
@@ -33,9 +37,10 @@ typedef struct {
 
 /* Characterizes a single trace operation (allocator request) */
 typedef struct {
-    enum {ALLOC, FREE} type; /* type of request */
+    enum {ALLOC, FREE, REALLOC, BATCH_ALLOC, BATCH_FREE} type; /* type of request */
     int index;                        /* index for free() to use later */
-    int size;                         /* byte size of alloc request */
+    int size;                         /* byte size of alloc or realloc request */
+    int count;                        /* ids index..index+count-1 in a batch request */
 } traceop_t;
 
 /* Holds the information for one trace file*/
@@ -44,9 +49,101 @@ typedef struct {
     int num_ops;         /* number of distinct requests */
     traceop_t *ops;      /* array of requests */
     allocated_block_t *blocks; /* array of blocks returned by umalloc */
+    void *mapping;       /* binary trace file the ops point into, or NULL */
+    size_t mapping_size;
 } trace_t;
 
+/*
+ * Binary traces start with this header and are followed by num_ops records
+ * laid out exactly as traceop_t, in host byte order, so read_trace maps the
+ * file and uses the records in place. record_size guards against a build
+ * with a different traceop_t.
+ */
+#define TRACE_MAGIC "UMTRACE1"
+typedef struct {
+    char magic[8];        /* TRACE_MAGIC, not NUL terminated */
+    uint32_t record_size; /* sizeof(traceop_t) */
+    int32_t num_ids;
+    int32_t num_ops;
+    uint32_t reserved;    /* 0; pads the records to 8 bytes */
+} trace_header_t;
+
+/*
+ * Captures, which capture.so writes from inside a program it is preloaded
+ * into, start with this header and are followed by a capture_record_t per
+ * malloc, free, realloc or calloc call, in chunks per thread. read_trace
+ * and convert_trace turn them into traces.
+ */
+#define CAPTURE_MAGIC "UMCAPT01"
+typedef struct {
+    char magic[8];        /* CAPTURE_MAGIC, not NUL terminated */
+    uint32_t record_size; /* sizeof(capture_record_t) */
+    uint32_t reserved;    /* 0 */
+} capture_header_t;
+
+enum {CAPTURE_MALLOC, CAPTURE_FREE, CAPTURE_REALLOC, CAPTURE_CALLOC};
+
+typedef struct {
+    uint64_t time;   /* ns on CLOCK_MONOTONIC when the call returned, or for free was made */
+    uint64_t ptr;    /* the block returned, or freed */
+    uint64_t old;    /* the block realloc was passed */
+    uint64_t size;   /* bytes asked for; nmemb * size for calloc */
+    uint32_t thread; /* kernel thread id of the caller */
+    uint32_t op;     /* CAPTURE_MALLOC and the rest */
+} capture_record_t;
+
+#define TRACE_CHUNK_OPS 65536 /* ops per buffer of a trace stream */
+
+/*
+ * Reads a trace, text or binary, a chunk of ops at a time, for traces too
+ * large to hold whole. A reader thread fills one of two buffers while the
+ * caller replays the other, so memory stays bounded by the chunk size.
+ */
+typedef struct {
+    int num_ids;              /* as given in the trace header */
+    int num_ops;
+    FILE *file;
+    char *filename;
+    bool binary;
+    int ops_left;             /* binary records still to be read */
+    int chunk_ops;
+    traceop_t *buffers[2];
+    int counts[2];            /* ops in each filled buffer, 0 at the end, -1 while empty */
+    int next;                 /* buffer next_chunk hands out next */
+    bool held;                /* the caller is replaying the other buffer */
+    bool stop;                /* close_trace_stream ends the reader early */
+    pthread_t reader;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+} trace_stream_t;
+
+/*
+ * The blocks of the live ids of a streamed trace, in an open addressed
+ * table with linear probing, so memory follows the live set instead of
+ * num_ids. Pointers into it last until the next get or remove. The
+ * tables come from map_memory.
+ */
+#define BLOCK_MAP_EMPTY -1
+typedef struct {
+    int *ids;                 /* BLOCK_MAP_EMPTY in unused slots */
+    allocated_block_t *blocks;
+    size_t capacity;          /* a power of two */
+    size_t count;
+} block_map_t;
+
 void appl_error(char *msg);
 void malloc_error(int opnum, char *msg);
 trace_t *read_trace(char *filename, int verbose);
-void free_trace(trace_t *trace);
\ No newline at end of file
+trace_t *read_capture(char *filename, long thread);
+void free_trace(trace_t *trace);
+void write_trace(trace_t *trace, char *filename, int binary);
+int trace_leftovers(trace_t *trace, int *ids);
+trace_stream_t *open_trace_stream(char *filename, int chunk_ops);
+traceop_t *next_chunk(trace_stream_t *stream, int *count);
+void close_trace_stream(trace_stream_t *stream);
+void *map_memory(size_t size);
+void unmap_memory(void *memory, size_t size);
+block_map_t *block_map_create(void);
+allocated_block_t *block_map_get(block_map_t *map, int id);
+void block_map_remove(block_map_t *map, int id);
+void block_map_free(block_map_t *map);
\ No newline at end of file
@@ -77,6 +77,26 @@ while ($line = <STDIN>) {
     # save the line for output later
     $lines[$requestnum++] = $line;
 
+    # a batch request (A <id> <count> <size>, F <id> <count>) stands for
+    # one allocate or free per id in its range
+    if ($cmd eq "A" or $cmd eq "F") {
+	for ($batch_id = $id; $batch_id < $id + $size; $batch_id++) {
+	    if ($cmd eq "A") {
+		if (exists($HASH{$batch_id})) {
+		    die "$0: ERROR[$linenum]: allocate with no intervening free.\n";
+		}
+		$HASH{$batch_id} = "a";
+	    }
+	    else {
+		if (!exists($HASH{$batch_id})) {
+		    die "$0: ERROR[$linenum]: freeing unallocated block.\n";
+		}
+		delete $HASH{$batch_id};
+	    }
+	}
+	next;
+    }
+
     if ($cmd eq "a" and $HASH{$id} eq "a") {
 	die "$0: ERROR[$linenum]: allocate with no intervening free.\n";
     }
@@ -0,0 +1,64 @@
+#!/usr/bin/perl
+#!/usr/local/bin/perl
+
+$out_filename = $ARGV[0];
+$out_filename = "batch.rep" unless $out_filename;
+$num_rounds = $ARGV[1];
+$num_rounds = 100 unless $num_rounds;
+$max_batch = $ARGV[2];
+$max_batch = 256 unless $max_batch;
+@node_sizes = (24, 40, 56, 104, 200);
+
+# Create trace
+# Every round allocates a batch of same-sized nodes plus a few odd blocks,
+# then frees the batch from two rounds back: one in four a node at a time,
+# the rest as a single batch free
+$num_blocks = 0;
+for ($i = 0;  $i < $num_rounds; $i += 1) {
+    $size = $node_sizes[int(rand @node_sizes)];
+    $count = 16 + int(rand($max_batch - 15));
+    push @trace, "A $num_blocks $count $size";
+    push @batches, [$num_blocks, $count];
+    $num_blocks += $count;
+
+    for ($j = 0; $j < 4; $j += 1) {
+        $size = 1 + int(rand 2000);
+        push @trace, "a $num_blocks $size";
+        push @singles, $num_blocks;
+        $num_blocks += 1;
+    }
+    while (@singles > 8) {
+        $id = shift @singles;
+        push @trace, "f $id";
+    }
+
+    if (@batches > 2) {
+        ($id, $count) = @{shift @batches};
+        if ($i % 4 == 0) {
+            for ($j = $count - 1; $j >= 0; $j -= 1) {
+                push @trace, "f " . ($id + $j);
+            }
+        } else {
+            push @trace, "F $id $count";
+        }
+    }
+}
+foreach $batch (@batches) {
+    push @trace, "F $batch->[0] $batch->[1]";
+}
+foreach $id (@singles) {
+    push @trace, "f $id";
+}
+
+# Open output file
+open OUTFILE, ">$out_filename" or die "Cannot create $out_filename\n";
+
+$num_ops = @trace;
+print OUTFILE "$num_blocks\n";
+print OUTFILE "$num_ops\n";
+
+foreach $line (@trace) {
+    print OUTFILE "$line\n";
+}
+
+close OUTFILE;
@@ -0,0 +1,58 @@
+#!/usr/bin/perl
+#!/usr/local/bin/perl
+
+$out_filename = $ARGV[0];
+$out_filename = "large.rep" unless $out_filename;
+$num_blocks = $ARGV[1];
+$num_blocks = 1200 unless $num_blocks;
+$max_blk_size = $ARGV[2];
+$max_blk_size = 4096 unless $max_blk_size;
+$min_large_size = 65536;
+$max_large_size = 262144;
+
+# Create trace
+# Make a series of malloc()s, one in eight of them large enough to be mapped
+for ($i = 0;  $i < $num_blocks; $i += 1) {
+    if (int(rand 8) == 0) {
+        $size = $min_large_size + int(rand($max_large_size - $min_large_size));
+    } else {
+        $size = int(rand $max_blk_size);
+    }
+    $op = {};
+    $op->{type} = "a";
+    $op->{seq} = $i;
+    $op->{size} = $size;
+    push @trace, $op;
+}
+# Insert free()s in proper places
+for ($i = 0;  $i < $num_blocks; $i += 1) {
+    for ($minval = $i; $minval < $num_blocks + $i; $minval += 1) {
+        if (($trace[$minval]->{type} eq "a") && ($trace[$minval]->{seq} == $i)) {
+            last;
+        }
+    }
+    $pos = int(rand($num_blocks + $i - $minval - 1) + $minval + 1);
+    $op = {};
+    $op->{type} = "f";
+    $op->{seq} = $i;
+    splice @trace, $pos, 0, $op;
+}
+
+# Open output file
+open OUTFILE, ">$out_filename" or die "Cannot create $out_filename\n";
+
+# Calculate misc parameters
+$num_ops = 2*$num_blocks;
+
+print OUTFILE "$num_blocks\n";
+print OUTFILE "$num_ops\n";
+
+for ($i = 0;  $i < 2*$num_blocks; $i += 1) {
+    if ($trace[$i]->{type} eq "a") {
+        print OUTFILE "$trace[$i]->{type} $trace[$i]->{seq} $trace[$i]->{size}\n";
+    } else {
+        print OUTFILE "$trace[$i]->{type} $trace[$i]->{seq}\n";
+    }
+}
+
+close OUTFILE;
@@ -0,0 +1,40 @@
+#!/usr/bin/perl
+#!/usr/local/bin/perl
+
+$out_filename = $ARGV[0];
+$out_filename = "realloc.rep" unless $out_filename;
+$start_size = $ARGV[1];
+$start_size = 512 unless $start_size;
+$step_size = $ARGV[2];
+$step_size = 128 unless $step_size;
+$num_iters = $ARGV[3];
+$num_iters = 4800 unless $num_iters;
+$small_size = $ARGV[4];
+$small_size = 128 unless $small_size;
+
+# Open output file
+open OUTFILE, ">$out_filename" or die "Cannot create $out_filename\n";
+
+# Calculate misc parameters
+$num_blocks = $num_iters + 2;
+$num_ops = 3*$num_iters + 4;
+
+print OUTFILE "$num_blocks\n";
+print OUTFILE "$num_ops\n";
+
+# Grow block 0 a step at a time while a small block is allocated right
+# behind it and the previous small block is freed
+print OUTFILE "a 0 $start_size\n";
+print OUTFILE "a 1 $small_size\n";
+$size = $start_size;
+for ($i = 1;  $i <= $num_iters; $i += 1) {
+    $size += $step_size;
+    $blk = $i + 1;
+    print OUTFILE "r 0 $size\n";
+    print OUTFILE "a $blk $small_size\n";
+    print OUTFILE "f $i\n";
+}
+print OUTFILE "f 0\n";
+print OUTFILE "f " . ($num_iters + 1) . "\n";
+
+close OUTFILE;
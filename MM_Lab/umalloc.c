@@ -1,8 +1,22 @@
+#define _GNU_SOURCE /* mremap */
 #include "umalloc.h"
 #include "csbrk.h"
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
 #include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include "ansicolors.h"
+#ifdef UMALLOC_TRACE
+#include <fcntl.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#endif
 
 const char author[] = ANSI_BOLD ANSI_COLOR_RED "Vihaan Mehta - vjm655" ANSI_RESET;
 
@@ -11,74 +25,211 @@ const char author[] = ANSI_BOLD ANSI_COLOR_RED "Vihaan Mehta - vjm655" ANSI_RESE
  * struct, they can be adjusted as necessary.
  */
 
+#define FIT_PROBES 8 /* blocks examined in a ranged class before moving up */
+#define CSBRK_MAX 65536 /* csbrk refuses larger increments */
+#define PAGE_ROUND(x) (((x) + PAGESIZE - 1) & ~((uintptr_t) PAGESIZE - 1))
+#define TRIM_PAD (16 * 1024) /* free bytes an automatic trim leaves at the top of the heap */
+#define SLAB_MIN_DEMAND 512 /* requests a slab class sees before it gets slabs */
+#define SLAB_GROW (8 * PAGESIZE) /* heap growth when no free block can hold a slab */
+#define SLAB_MAP_WORDS ((PAGESIZE / ALIGNMENT + 63) / 64)
+#define SLAB_SPAN (1UL << 32) /* bytes above the first heap region that can hold slabs */
+#define SLAB_PAGE_WORDS (SLAB_SPAN / PAGESIZE / 64)
+#define TCACHE_CLASSES 16 /* exact classes (blocks up to 272 bytes) cached per thread */
+#define TCACHE_BATCH 8 /* blocks moved between a thread cache and the heap at once */
+#define TCACHE_MAX 32 /* cached blocks per class before a batch is drained */
+#define TCACHE_BINS (TCACHE_CLASSES + SLAB_CLASSES) /* magazines: heap classes, then slab classes */
+#define SLAB_BIN(class) (TCACHE_CLASSES + (class))
+#define TCACHE_COUNT 128 /* thread caches; threads beyond this use heap_lock directly */
+
+/*
+ * tcache_t - a thread's magazines of allocated blocks for the small exact
+ * classes and of objects for the slab classes. Cached payloads are linked
+ * through their first word, and the shared heap still sees them as
+ * allocated. Blocks handed out by a cache carry its id in their header;
+ * other threads free them by pushing onto remote_frees with a single CAS,
+ * and the owner takes the whole list with one exchange on its next umalloc.
+ */
+typedef struct {
+    void *bins[TCACHE_BINS];
+    int counts[TCACHE_BINS];
+    unsigned generation; // heap_generation the cache was filled from
+    atomic_bool active; // claimed by a live thread
+    _Alignas(64) _Atomic(void *) remote_frees; // written by other threads
+} tcache_t;
+
+/*
+ * slab_t - the header of a slab: an allocated heap block of exactly one
+ * page whose payload, starting with this header, is page-aligned; its block
+ * header is the last word of the page before. The rest of the page holds
+ * objects of a single class back to back, with no per-object metadata; the
+ * header is found by masking an object's address down to its page. Slabs
+ * with a free object are on a doubly linked list per class.
+ */
+typedef struct slab_struct {
+    struct slab_struct *next;
+    struct slab_struct *prev;
+    uint32_t obj_size;
+    uint16_t class_id;
+    uint16_t capacity;
+    uint16_t free_count;
+    uint64_t free_map[SLAB_MAP_WORDS]; // bit i is set while object i is free
+} slab_t;
+
+#define SLAB_HEADER ALIGN(sizeof(slab_t))
+
+#define FREE_LINKS (sizeof(mem_block_header_t) + sizeof(tree_node_t)) /* header and every link of a free block */
+
+_Static_assert(FREE_LINKS + sizeof(size_t) <= TREE_MIN_SIZE, "tree blocks must hold their links");
+
 mem_block_header_t *free_heads[BIN_COUNT];
-const int bucketSizes[4] = {1024, 2848, 4080, 4096};
-int binUsage[4] = {0, 0, 0, 0};
-int csBrkCt = 0;
-int splitCount = 0;
-int mallocSuccess = 0;
-int coalesceCount = 0;
-int nullCount = 0;
-int freeCount = 0;
-int extensionCheck = 0;
+uint64_t bin_bitmap[BITMAP_WORDS]; // bit i is set iff free_heads[i] != NULL
+tree_node_t *free_tree = NULL; // root of the size-ordered tree of large free blocks
+static char *heap_end = NULL; // end of the most recent csbrk region
+static mem_block_header_t *heap_epilogue = NULL;
+heap_region_t *heap_regions = NULL; // every csbrk region, in a mapping of its own
+size_t region_count = 0;
+static size_t region_capacity = 0;
+
+// heap_lock guards the free lists, the bitmap, the heap bounds and the
+// counters below; thread caches only take it to refill or drain.
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t tcache_key;
+static pthread_once_t tcache_key_once = PTHREAD_ONCE_INIT;
+static unsigned heap_generation = 1; // bumped by uinit and ureset so stale caches are dropped
+static tcache_t tcaches[TCACHE_COUNT]; // cache id i + 1 lives in tcaches[i]
+static __thread tcache_t *tcache = NULL;
+static __thread bool tcache_unavailable = false;
+size_t mmap_bytes = 0; // bytes currently mapped for large blocks, next to csbrk's sbrk_bytes
+static size_t mmap_threshold = DEFAULT_MMAP_THRESHOLD;
+static size_t trim_threshold = DEFAULT_TRIM_THRESHOLD;
+static size_t auto_trim_floor = 0; // top blocks an automatic trim gave back and the heap grew over again
+static size_t auto_trimmed = 0; // size of the top block last trimmed automatically, until extend regrows it
+static char *heap_base = NULL; // start of the first csbrk region, which the break never drops below
+static uint64_t slab_pages[SLAB_PAGE_WORDS]; // bit i is set iff page i above heap_base is a slab
+static size_t slab_pages_used = 0; // words of slab_pages that may have a bit set
+static slab_t *slab_partial[SLAB_CLASSES]; // slabs with a free object, per class
+static unsigned slab_demand[SLAB_CLASSES]; // requests seen per class, up to SLAB_MIN_DEMAND
+static ustats_t stats; // the UMALLOC_STATS counters
+
+#ifdef UMALLOC_STATS
+#define STAT_ADD(field, n) __atomic_add_fetch(&stats.field, (n), __ATOMIC_RELAXED)
+#define STAT_ALLOC(payload) stat_block(payload, 1)
+#define STAT_FREE(payload) stat_block(payload, -1)
+#else
+#define STAT_ADD(field, n) ((void) 0)
+#define STAT_ALLOC(payload) ((void) 0)
+#define STAT_FREE(payload) ((void) 0)
+#endif
+
+#ifdef UMALLOC_TRACE
+#define TRACE_RING_EVENTS 16384 /* events a thread buffers for the flusher, a power of two */
+#define TRACE_RINGS 256 /* threads with a ring; later threads' events are counted as dropped */
+#define TRACE_FLUSH_NS 1000000 /* flusher's sleep when every ring was empty */
 
 /*
- * select_bin - selects a free list bin to use based on the
- * block size.
+ * trace_ring_t - a thread's events on their way to the trace file. Only the
+ * owning thread advances head and only the flusher advances tail, so
+ * neither needs a lock. A full ring drops events and counts them instead of
+ * waiting for the flusher.
  */
-mem_block_header_t *select_bin(size_t size)
+typedef struct {
+    _Alignas(64) atomic_size_t head; // events written
+    atomic_size_t dropped; // events there was no room for
+    _Alignas(64) atomic_size_t tail; // events flushed
+    size_t reported; // dropped events the flusher has recorded
+    uint16_t id;
+    uevent_t events[TRACE_RING_EVENTS];
+} trace_ring_t;
+
+static _Atomic(trace_ring_t *) trace_rings[TRACE_RINGS];
+static atomic_int trace_ring_count = 0; // rings claimed, or tried for
+static atomic_size_t trace_lost = 0; // events of threads without a ring
+static size_t trace_lost_reported = 0;
+static int trace_fd = -1;
+static atomic_bool trace_stopping = false;
+static pthread_t trace_flusher_thread;
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+static __thread trace_ring_t *trace_ring = NULL;
+static __thread bool trace_unavailable = false;
+static __thread int trace_nesting = 0; // calls in progress on this thread
+static __thread uevent_t trace_event; // the outermost of them
+
+// TRACE_OP opens the event of a call for the rest of the enclosing block.
+#define TRACE_OP(op, size, class_id) \
+    __attribute__((cleanup(trace_end))) int trace_depth = trace_begin(op, size, class_id)
+#define TRACE_PROBE() (trace_event.probes += (trace_event.probes != UINT16_MAX))
+#define TRACE_FLAG(flag) (trace_event.flags |= (flag))
+#else
+#define TRACE_OP(op, size, class_id) ((void) 0)
+#define TRACE_PROBE() ((void) 0)
+#define TRACE_FLAG(flag) ((void) 0)
+#endif
+
+static const uint8_t class_lookup[LARGE_CLASS_LIMIT / ALIGNMENT] = SIZE_CLASS_LOOKUP;
+
+_Static_assert(BIN_COUNT <= 256, "class ids must fit in class_lookup");
+_Static_assert(MIN_BLOCK_SIZE + TCACHE_CLASSES * ALIGNMENT <= EXACT_CLASS_LIMIT,
+               "thread caches need exact classes");
+
+/*
+ * size_class - maps a block size (header included) to its size class.
+ */
+int size_class(size_t size)
 {
+    return (size < LARGE_CLASS_LIMIT) ? class_lookup[size / ALIGNMENT] : BIN_COUNT - 1;
+}
 
-    if (size <= bucketSizes[0] - 16)
-    {
-        return free_heads[0];
-    }
-    else if (size > bucketSizes[0] - 16 && size <= bucketSizes[1] - 16)
-    {
-        return free_heads[1];
-    }
-    else if (size > bucketSizes[1] - 16 && size <= bucketSizes[2] - 16)
-    {
-        return free_heads[2];
-    }
-    else if (size > bucketSizes[2] - 16)
-    {
-        return free_heads[3];
-    }
-    else
+/*
+ * block_size_for - returns the block size needed to hold a payload of size
+ * bytes, or 0 if the request cannot be represented.
+ */
+static size_t block_size_for(size_t size)
+{
+    if (size > (SIZE_MAX >> 4) - HEADER_SIZE - ALIGNMENT)
     {
-        printf("ERROR IN SELECT_BIN\n\n");
-        return NULL;
+        return 0;
     }
+
+    size_t block_size = ALIGN(size + HEADER_SIZE);
+    return (block_size < MIN_BLOCK_SIZE) ? MIN_BLOCK_SIZE : block_size;
 }
 
+/*
+ * find_bucket - returns the size class a payload of size bytes is served from.
+ */
 int find_bucket(size_t size)
 {
-    if (size <= bucketSizes[0] - 16)
-    {
-        binUsage[0]++;
-        return 0;
-    }
-    else if (size > bucketSizes[0] - 16 && size <= bucketSizes[1] - 16)
-    {
-        binUsage[1]++;
-        return 1;
-    }
-    else if (size > bucketSizes[1] - 16 && size <= bucketSizes[2] - 16)
-    {
-        binUsage[2]++;
-        return 2;
-    }
-    else if (size > bucketSizes[2] - 16)
-    {
-        binUsage[3]++;
-        return 3;
-    }
-    else
+    return size_class(block_size_for(size));
+}
+
+/*
+ * select_bin - selects a free list bin to use based on the
+ * block size.
+ */
+mem_block_header_t *select_bin(size_t size)
+{
+    return free_heads[find_bucket(size)];
+}
+
+/*
+ * next_nonempty_bin - returns the first bin at or after from with a free
+ * block in it, or -1 if there is none.
+ */
+static int next_nonempty_bin(int from)
+{
+    for (int word = from / 64; word < BITMAP_WORDS; word++)
     {
-        printf("ERROR IN FIND_BUCKET\n\n");
-        return 0;
+        uint64_t bits = bin_bitmap[word];
+        if (word == from / 64)
+        {
+            bits &= ~0ULL << (from % 64);
+        }
+        if (bits)
+        {
+            return word * 64 + __builtin_ctzll(bits);
+        }
     }
+    return -1;
 }
 
 /*
@@ -86,8 +237,7 @@ int find_bucket(size_t size)
  */
 bool is_allocated(mem_block_header_t *block)
 {
-    // Student TODO
-    return 0;
+    return block->block_metadata & ALLOC_BIT;
 }
 
 /*
@@ -95,7 +245,7 @@ bool is_allocated(mem_block_header_t *block)
  */
 void allocate(mem_block_header_t *block)
 {
-    // Student TODO
+    block->block_metadata |= ALLOC_BIT;
 }
 
 /*
@@ -103,7 +253,7 @@ void allocate(mem_block_header_t *block)
  */
 void deallocate(mem_block_header_t *block)
 {
-    // Student TODO
+    block->block_metadata &= ~ALLOC_BIT;
 }
 
 /*
@@ -111,8 +261,65 @@ void deallocate(mem_block_header_t *block)
  */
 size_t get_size(mem_block_header_t *block)
 {
-    // Student TODO
-    return sizeof(mem_block_header_t) + get_payload(block);
+    return __atomic_load_n(&block->block_metadata, __ATOMIC_RELAXED) & SIZE_MASK;
+}
+
+/*
+ * get_owner - gets the id of the thread cache an allocated block belongs to.
+ */
+static unsigned get_owner(mem_block_header_t *block)
+{
+    return __atomic_load_n(&block->block_metadata, __ATOMIC_RELAXED) >> OWNER_SHIFT;
+}
+
+/*
+ * is_mmapped - returns true if a block is a mapping of its own.
+ */
+static bool is_mmapped(mem_block_header_t *block)
+{
+    return __atomic_load_n(&block->block_metadata, __ATOMIC_RELAXED) & MMAP_BIT;
+}
+
+/*
+ * slab_page - returns the index of ptr's page in slab_pages, or
+ * SLAB_SPAN / PAGESIZE if it is out of range.
+ */
+static size_t slab_page(void *ptr)
+{
+    char *base = __atomic_load_n(&heap_base, __ATOMIC_RELAXED);
+    size_t page = ((uintptr_t) ptr / PAGESIZE) - ((uintptr_t) base / PAGESIZE);
+    return (base == NULL || page >= SLAB_SPAN / PAGESIZE) ? SLAB_SPAN / PAGESIZE : page;
+}
+
+/*
+ * in_slab - returns true if ptr points into a slab. No heap block's payload
+ * starts inside a slab's page, so one bit per page tells them apart.
+ */
+static bool in_slab(void *ptr)
+{
+    size_t page = slab_page(ptr);
+    return page < SLAB_SPAN / PAGESIZE
+        && (__atomic_load_n(&slab_pages[page / 64], __ATOMIC_RELAXED) >> (page % 64)) & 1;
+}
+
+/*
+ * slab_of - returns the header of the slab an object lives in.
+ */
+static slab_t *slab_of(void *ptr)
+{
+    return (slab_t *) ((uintptr_t) ptr & ~((uintptr_t) PAGESIZE - 1));
+}
+
+/*
+ * set_prev_free - updates the PREV_FREE bit of a block. The block may be
+ * allocated and have its header read by a thread that does not hold
+ * heap_lock, so the word is written in one piece.
+ */
+static void set_prev_free(mem_block_header_t *block, bool prev_free)
+{
+    size_t metadata = __atomic_load_n(&block->block_metadata, __ATOMIC_RELAXED);
+    metadata = prev_free ? (metadata | PREV_FREE) : (metadata & ~PREV_FREE);
+    __atomic_store_n(&block->block_metadata, metadata, __ATOMIC_RELAXED);
 }
 
 /*
@@ -120,8 +327,7 @@ size_t get_size(mem_block_header_t *block)
  */
 mem_block_header_t *get_next(mem_block_header_t *block)
 {
-    // Student TODO
-    return NULL;
+    return block->next;
 }
 
 /*
@@ -131,357 +337,2378 @@ mem_block_header_t *get_next(mem_block_header_t *block)
  */
 void set_block_metadata(mem_block_header_t *block, size_t size, bool alloc)
 {
-
-    // Optional student todo
+    block->block_metadata = size | alloc;
 }
 
 /*
  * get_payload - gets the payload of the block.
  */
-int get_payload(mem_block_header_t *block)
+void *get_payload(mem_block_header_t *block)
 {
-    return block->block_metadata >> 1;
+    return (char *) block + HEADER_SIZE;
 }
 
 /*
- * get_header - given a payload, returns the block.
+ * get_block - given a payload, returns the block.
  */
-mem_block_header_t *get_header(void *payload)
+mem_block_header_t *get_block(void *payload)
 {
-    // Student TODO
-    return NULL;
+    return (mem_block_header_t *) ((char *) payload - HEADER_SIZE);
 }
 
 /*
- * The following are helper functions that can be implemented to assist in your
- * design, but they are not required.
+ * next_block - returns the block physically after this one.
  */
+static mem_block_header_t *next_block(mem_block_header_t *block)
+{
+    return (mem_block_header_t *) ((char *) block + get_size(block));
+}
 
 /*
- * find - finds a free block that can satisfy the umalloc request.
+ * set_footer - copies a free block's size into its last word.
  */
-mem_block_header_t *find(size_t payload_size)
+static void set_footer(mem_block_header_t *block)
 {
-    // Student TODO
-    return NULL;
+    *(size_t *) ((char *) block + get_size(block) - sizeof(size_t)) = get_size(block);
+}
+
+/*
+ * tree_node - returns the tree links of a free block.
+ */
+static tree_node_t *tree_node(mem_block_header_t *block)
+{
+    return (tree_node_t *) (block + 1);
+}
+
+/*
+ * tree_block - returns the free block that holds node.
+ */
+static mem_block_header_t *tree_block(tree_node_t *node)
+{
+    return (mem_block_header_t *) node - 1;
 }
 
 /*
- * extend - extends the heap if more memory is required.
+ * tree_before - returns true if block a sorts before block b in free_tree.
  */
-mem_block_header_t *extend(size_t numBytesRequested, int bucketSize)
+static bool tree_before(mem_block_header_t *a, mem_block_header_t *b)
 {
+    size_t a_size = get_size(a), b_size = get_size(b);
+    return a_size < b_size || (a_size == b_size && a < b);
+}
 
-    mem_block_header_t *extension = (mem_block_header_t *) csbrk(numBytesRequested);
-    mem_block_header_t *temp = extension;
-    
-    if (extension == NULL)
+/*
+ * tree_replace - puts node (which may be NULL) where old hangs from its parent.
+ */
+static void tree_replace(tree_node_t *old, tree_node_t *node)
+{
+    if (old->parent == NULL)
     {
-        printf("Error occurred in extend \n");
-        return NULL;
+        free_tree = node;
     }
-
-    int loopCount = numBytesRequested / bucketSize;
-    
-    for (int x = 0; x < loopCount; x++)
+    else if (old == old->parent->left)
     {
-        temp->block_metadata = 0;
-        temp->block_metadata |= (bucketSize - sizeof(mem_block_header_t)) << 1;
-        
-        if (x < loopCount - 1) {
-            temp->next = (mem_block_header_t*) ((char*) temp + bucketSize);
-            temp = temp->next;
-        }
-        else {
-            temp->next = NULL;
-        }
+        old->parent->left = node;
+    }
+    else
+    {
+        old->parent->right = node;
+    }
+    if (node != NULL)
+    {
+        node->parent = old->parent;
     }
-    
-    return extension;
 }
 
 /*
- * split - splits a given block in parts, one allocated, one free.
+ * tree_rotate - rotates node down to the left, or to the right if left is
+ * false, lifting its child on the other side into its place.
  */
-mem_block_header_t *split(mem_block_header_t *block, size_t new_block_size)
+static void tree_rotate(tree_node_t *node, bool left)
 {
-    // Student TODO
-    return NULL;
+    tree_node_t *child = left ? node->right : node->left;
+    tree_node_t *inner = left ? child->left : child->right;
+
+    if (left)
+    {
+        node->right = inner;
+        child->left = node;
+    }
+    else
+    {
+        node->left = inner;
+        child->right = node;
+    }
+    if (inner != NULL)
+    {
+        inner->parent = node;
+    }
+    tree_replace(node, child);
+    node->parent = child;
 }
 
+/*
+ * tree_insert - adds a free block to free_tree and rebalances it.
+ */
+static void tree_insert(mem_block_header_t *block)
+{
+    tree_node_t *node = tree_node(block);
+    tree_node_t *parent = NULL;
+    tree_node_t **link = &free_tree;
 
-void print(int bin) {
-    if (free_heads[bin] != NULL) {
-        printf("che\n");
-        mem_block_header_t* temp1 = free_heads[bin];
-        do {
-            // address : size : allocation status : next
-            printf("      %ld : %ld : %lx : %ld\n", 
-                    (uintptr_t) temp1, temp1->block_metadata >> 1, temp1->block_metadata & 0x1,(uintptr_t) temp1->next);
-            temp1 = temp1->next;
-        } while (temp1);
-        printf("End New\n");
+    while (*link != NULL)
+    {
+        parent = *link;
+        link = tree_before(block, tree_block(parent)) ? &parent->left : &parent->right;
     }
-    else {
-        printf("free_head[bin] was null\n");
+    node->left = node->right = NULL;
+    node->parent = parent;
+    node->red = true;
+    *link = node;
+
+    while ((parent = node->parent) != NULL && parent->red)
+    {
+        tree_node_t *grand = parent->parent;
+        bool left = (parent == grand->left);
+        tree_node_t *uncle = left ? grand->right : grand->left;
+
+        if (uncle != NULL && uncle->red)
+        {
+            parent->red = uncle->red = false;
+            grand->red = true;
+            node = grand;
+            continue;
+        }
+        if (node == (left ? parent->right : parent->left))
+        {
+            tree_rotate(parent, left);
+            node = parent;
+            parent = node->parent;
+        }
+        parent->red = false;
+        grand->red = true;
+        tree_rotate(grand, !left);
     }
+    free_tree->red = false;
 }
 
 /*
- * coalesce - coalesces a free memory block with neighbors.
+ * tree_remove - takes a free block out of free_tree, rebalances it and
+ * clears the block's tree links.
  */
-mem_block_header_t *coalesce(mem_block_header_t *block, mem_block_header_t* next)
-{    
-        if (block != NULL && next != NULL && (mem_block_header_t *)((char *)block + get_size(block)) == next) {
-           coalesceCount++;
-           block->block_metadata = 0;
-           block->block_metadata |= ((get_payload(block) + get_size(next)) << 1);   
-           block->next = next->next;
-           
-           return block;
-           //next->next = NULL;
-          // next->block_metadata = 0;
-          
-           
-        }   
-    return NULL;
+static void tree_remove(mem_block_header_t *block)
+{
+    tree_node_t *node = tree_node(block);
+    tree_node_t *child, *parent;
+    bool removed_red = node->red;
+
+    if (node->left == NULL || node->right == NULL)
+    {
+        child = (node->left != NULL) ? node->left : node->right;
+        parent = node->parent;
+        tree_replace(node, child);
+    }
+    else
+    {
+        tree_node_t *next = node->right;
+        while (next->left != NULL)
+        {
+            next = next->left;
+        }
+        removed_red = next->red;
+        child = next->right;
+        if (next->parent == node)
+        {
+            parent = next;
+        }
+        else
+        {
+            parent = next->parent;
+            tree_replace(next, child);
+            next->right = node->right;
+            next->right->parent = next;
+        }
+        tree_replace(node, next);
+        next->left = node->left;
+        next->left->parent = next;
+        next->red = node->red;
+    }
+
+    while (!removed_red && child != free_tree && (child == NULL || !child->red))
+    {
+        bool left = (child == parent->left);
+        tree_node_t *sibling = left ? parent->right : parent->left;
+
+        if (sibling->red)
+        {
+            sibling->red = false;
+            parent->red = true;
+            tree_rotate(parent, left);
+            sibling = left ? parent->right : parent->left;
+        }
+        tree_node_t *near = left ? sibling->left : sibling->right;
+        tree_node_t *far = left ? sibling->right : sibling->left;
+        if ((near == NULL || !near->red) && (far == NULL || !far->red))
+        {
+            sibling->red = true;
+            child = parent;
+            parent = child->parent;
+            continue;
+        }
+        if (far == NULL || !far->red)
+        {
+            near->red = false;
+            sibling->red = true;
+            tree_rotate(sibling, !left);
+            sibling = left ? parent->right : parent->left;
+            far = left ? sibling->right : sibling->left;
+        }
+        sibling->red = parent->red;
+        parent->red = false;
+        far->red = false;
+        tree_rotate(parent, left);
+        child = free_tree;
+    }
+    if (child != NULL)
+    {
+        child->red = false;
+    }
+    memset(node, 0, sizeof(tree_node_t));
 }
 
 /*
- * uinit - Used initialize metadata required to manage the heap
- * along with allocating initial memory.
+ * tree_best_fit - returns the smallest free block in free_tree of at least
+ * size bytes, the lowest addressed of several, or NULL if there is none.
  */
-int uinit()
+static mem_block_header_t *tree_best_fit(size_t size)
 {
-    for (int i = 0; i < BIN_COUNT; i++)
+    tree_node_t *best = NULL;
+
+    for (tree_node_t *node = free_tree; node != NULL; )
     {
-        free_heads[i] = extend(PAGESIZE, 1024);
+        TRACE_PROBE();
+        if (get_size(tree_block(node)) >= size)
+        {
+            best = node;
+            node = node->left;
+        }
+        else
+        {
+            node = node->right;
+        }
     }
-    
-    return 0;
+    return (best == NULL) ? NULL : tree_block(best);
 }
 
 /*
- * umalloc -  allocates size bytes and returns a pointer to the allocated memory.
+ * list_insert - pushes a free block onto the front of its size class.
  */
-void *umalloc(size_t size)
+static void list_insert(mem_block_header_t *block)
 {
-    extensionCheck++;
-    size_t sizeWithPadding = size;
-    if (sizeWithPadding % 16 != 0) {
-        sizeWithPadding += (16 - size % 16);
-    }
-
-
-    int bin = find_bucket(sizeWithPadding);
-    mem_block_header_t *head_ptr = free_heads[bin];
-    mem_block_header_t *prev_ptr = NULL;
-    int fit = 0;
-    
-    while (head_ptr != NULL)
-    {
-
-       int payload = get_payload(head_ptr);
-
-       if ((fit > 2 && payload >= sizeWithPadding))
-        {
-            
-            // First: Set the size and allocation status of newly allocated block. We calculated size with padding before
-            head_ptr->block_metadata |= 1;
-           
-            // Next: We split the memory block if the remaining portion of the free block is more than 64 bytes.
-            // Note: need to reorder list
-            mem_block_header_t* new_ptr = NULL;
-            if (payload - sizeWithPadding >= 64) {
-                splitCount++;
-            
-                // Calculate the address of the new free block
-                new_ptr = (mem_block_header_t *)((char *)head_ptr + sizeof(mem_block_header_t) + sizeWithPadding);
-            
-                // Set the metadata of the new free block
-                new_ptr->block_metadata = ((payload - sizeWithPadding - sizeof(mem_block_header_t)) << 1);
-            
-                // Update the metadata of the allocated block
-                head_ptr->block_metadata = (sizeWithPadding << 1) | 1; // Clear previous size and set new size
-            
-                // Insert the new free block into the free list
-                new_ptr->next = head_ptr->next;
-            
-                if (prev_ptr != NULL) {
-                    prev_ptr->next = new_ptr;
-                } else {
-                    free_heads[bin] = new_ptr;
-                }
-            }
-            else {
-            
-                
-            // Update pointers
-            if (prev_ptr != NULL)
-            {
-                // Update next values
-                prev_ptr->next = head_ptr->next;
-            }
-            else {
-                free_heads[bin] = head_ptr->next;
-            }
-        }
+    int bin = size_class(get_size(block));
 
-            // Finally, return the pointer
-            head_ptr->next = NULL;
-            mallocSuccess++;
-
-            return (void *)((char*) head_ptr + sizeof(mem_block_header_t));
-        }
-        fit++;
-        prev_ptr = head_ptr;
-        head_ptr = head_ptr->next;    
-    }
- 
-  if (extensionCheck > 25 && free_heads[bin] != NULL) {
-        extensionCheck = 0;
-        mem_block_header_t* extension = extend(PAGESIZE*2, PAGESIZE);
-        mem_block_header_t* traverse = free_heads[bin];
-        while (traverse->next != NULL) {
-            traverse = traverse->next;
-        }
-        traverse->next = extension;
-    } 
-
-
-    if (head_ptr == NULL) {
-        csBrkCt++;
-        
-        size_t totalSize = sizeWithPadding + sizeof(mem_block_header_t);
-        size_t totalBytesReceived = 0;
-        if (totalSize == PAGESIZE) {
-             totalBytesReceived = PAGESIZE;
-        }
-        else {
-             totalBytesReceived = (((int) (totalSize / PAGESIZE)) + 1) * PAGESIZE;
-        }
-        mem_block_header_t *newList = (mem_block_header_t*) csbrk(totalBytesReceived);
-        newList->next = NULL;
-        newList->block_metadata |= 1;
-        newList->block_metadata|= ((sizeWithPadding) << 1) | 1;
-
-        int difference = totalBytesReceived - totalSize;
-        if (difference >= 256) {
- 
-          
-                mem_block_header_t *split_ptr = (mem_block_header_t*) ((char*) newList + totalSize);
-                split_ptr->next = NULL;
-
-                if (split_ptr == NULL)
-                {
-                    printf("Error in malloc splitting");
-                }
-
-                // Mark the newly split block as free, and note its size
-                split_ptr->block_metadata &= 0;
-                split_ptr->block_metadata |= ((difference - sizeof(mem_block_header_t))<< 1);
-              
-
-                if (free_heads[bin] == NULL) {
-                   free_heads[bin] = split_ptr;
-                }
-                else {
-                    orderByAddress(free_heads[bin], split_ptr, bin, true);
-                }  
-        }    
-    
-        return (void*) ((char*) newList + sizeof(mem_block_header_t));
-    }
-     
-    return NULL;
+    block->prev = NULL;
+    block->next = free_heads[bin];
+    if (free_heads[bin] != NULL)
+    {
+        free_heads[bin]->prev = block;
+    }
+    free_heads[bin] = block;
+    bin_bitmap[bin / 64] |= 1ULL << (bin % 64);
+    if (get_size(block) >= TREE_MIN_SIZE)
+    {
+        tree_insert(block);
+    }
 }
 
-void orderByAddress(mem_block_header_t *head_ptr, mem_block_header_t *newBlock, int bin, bool single)
+/*
+ * list_remove - unlinks a free block from its size class.
+ */
+static void list_remove(mem_block_header_t *block)
 {
-   
-    
-    if (head_ptr == NULL || newBlock == NULL || bin < 0 || bin > (BIN_COUNT - 1))
+    int bin = size_class(get_size(block));
+
+    if (get_size(block) >= TREE_MIN_SIZE)
     {
-        return;
+        tree_remove(block);
     }
-   
-
-    uintptr_t newAdd = (uintptr_t) newBlock;
-    mem_block_header_t *traverse = head_ptr;
 
-    
-  
-    if (single) {
-        if ((uintptr_t) traverse > newAdd) {
-            newBlock->next = traverse;
-            free_heads[bin] = newBlock;
-            return;
-        }
-        while (traverse->next != NULL)
+    if (block->prev != NULL)
+    {
+        block->prev->next = block->next;
+    }
+    else
+    {
+        free_heads[bin] = block->next;
+        if (free_heads[bin] == NULL)
         {
+            bin_bitmap[bin / 64] &= ~(1ULL << (bin % 64));
+        }
+    }
+    if (block->next != NULL)
+    {
+        block->next->prev = block->prev;
+    }
+}
+
+/*
+ * The following are helper functions that can be implemented to assist in your
+ * design, but they are not required.
+ */
 
-            if ((uintptr_t)traverse->next > newAdd)
+/*
+ * find - finds a free block that can satisfy the umalloc request. Exact
+ * classes always fit, ranged classes below TREE_MIN_SIZE are probed a few
+ * blocks deep, and past them the best fit comes from free_tree: the
+ * smallest block large enough, at the lowest address.
+ */
+mem_block_header_t *find(size_t size)
+{
+    if (size < TREE_MIN_SIZE)
+    {
+        int bin = size_class(size);
+        int probes = 0;
+        for (mem_block_header_t *block = free_heads[bin]; block != NULL && probes < FIT_PROBES; block = block->next)
+        {
+            TRACE_PROBE();
+            if (get_size(block) >= size)
             {
-             
-                newBlock->next = traverse->next;
-                traverse->next = newBlock;
-                return;
+                return block;
             }
-            traverse = traverse->next;
+            probes++;
         }
-  
 
-       traverse->next = newBlock;
-       return;
-    }    
+        bin = next_nonempty_bin(bin + 1);
+        if (bin >= 0 && bin < size_class(TREE_MIN_SIZE))
+        {
+            return free_heads[bin];
+        }
+    }
+    return tree_best_fit(size);
 }
 
-/**
- * @param ptr the pointer to the memory to be freed,
- * must have been called by a previous malloc call
- * @brief frees the memory space pointed to by ptr.
+/*
+ * reserve_region - makes room in heap_regions for one more region. The table
+ * is mapped rather than taken from csbrk so that it never splits the heap.
+ * Returns false if there is no memory for it.
  */
-void ufree(void *ptr)
+static bool reserve_region()
 {
-    if (ptr == NULL) {
-        return;
+    if (region_count < region_capacity)
+    {
+        return true;
     }
-  
-
-    mem_block_header_t *to_free = (mem_block_header_t *)((char*) ptr - sizeof(mem_block_header_t));
-    to_free->block_metadata &= ~1;
-    to_free->next = NULL;
-    int size = get_payload(to_free);
-    int bin = find_bucket(size);
-
-    
-    
 
-    mem_block_header_t *head_ptr = free_heads[bin];
-
-    if (head_ptr == NULL) {
-        free_heads[bin] = to_free;
-    }
-    else {
-        orderByAddress(head_ptr, to_free, bin, true);
+    size_t capacity = (region_capacity == 0) ? PAGESIZE / sizeof(heap_region_t) : 2 * region_capacity;
+    void *table = (heap_regions == NULL)
+        ? mmap(NULL, capacity * sizeof(heap_region_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)
+        : mremap(heap_regions, region_capacity * sizeof(heap_region_t), capacity * sizeof(heap_region_t),
+                 MREMAP_MAYMOVE);
+    if (table == MAP_FAILED)
+    {
+        return false;
     }
+    heap_regions = table;
+    region_capacity = capacity;
+    return true;
+}
 
-    if (freeCount == 200) {
-    mem_block_header_t* temp = free_heads[bin];
-    mem_block_header_t* prev_ptr = NULL;
-    int count = 0;
-    while (temp != NULL && count < 10) {
-        
-        if (coalesce(prev_ptr, temp) == NULL) {
-            prev_ptr = temp; 
-            temp = temp->next;
-        }
-        else {
-            temp = prev_ptr->next;
-        }
-        count++;
-      }
-      freeCount = 0; 
-    }
-      freeCount++; 
-}
\ No newline at end of file
+/*
+ * extend - extends the heap if more memory is required. Returns a free block
+ * of at least size bytes that is not on any free list. The heap grows by
+ * exactly what is needed (at least a page) rather than whole pages. A region
+ * that starts where the previous one ended takes over its epilogue and merges
+ * with a free block in front of it.
+ */
+mem_block_header_t *extend(size_t size)
+{
+    size_t bytes = size + EPILOGUE_SIZE;
+    if (bytes < PAGESIZE)
+    {
+        bytes = PAGESIZE;
+    }
+    if (bytes > CSBRK_MAX)
+    {
+        return NULL;
+    }
+
+    // csbrk refuses oversized requests with NULL but passes on sbrk's (void *) -1.
+    char *mem = reserve_region() ? csbrk(bytes) : NULL;
+    if (mem == NULL || mem == (char *) -1)
+    {
+        printf("Error occurred in extend \n");
+        return NULL;
+    }
+    STAT_ADD(extends, 1);
+    TRACE_FLAG(UEVENT_EXTEND);
+    if (auto_trimmed > auto_trim_floor)
+    {
+        // The memory an automatic trim gave back was needed again; only
+        // larger top blocks are trimmed from now on.
+        auto_trim_floor = auto_trimmed;
+    }
+    auto_trimmed = 0;
+    STAT_ADD(heap_bytes, bytes);
+
+    mem_block_header_t *block;
+    size_t flags = 0;
+    if (mem == heap_end)
+    {
+        block = heap_epilogue;
+        flags = block->block_metadata & PREV_FREE;
+    }
+    else
+    {
+        // Skip the slack that puts the first payload on an aligned address.
+        block = get_block((void *) ALIGN((uintptr_t) mem + HEADER_SIZE));
+        if (heap_base == NULL)
+        {
+            __atomic_store_n(&heap_base, mem, __ATOMIC_RELAXED);
+        }
+        heap_regions[region_count++].first = block;
+    }
+
+    heap_end = mem + bytes;
+    heap_epilogue = get_block((void *) ((uintptr_t) heap_end & ~(uintptr_t) (ALIGNMENT - 1)));
+    set_block_metadata(heap_epilogue, 0, true);
+    heap_regions[region_count - 1].epilogue = heap_epilogue;
+
+    // Memory fresh from csbrk is zero.
+    set_block_metadata(block, (char *) heap_epilogue - (char *) block, false);
+    block->block_metadata |= flags | ZERO_BIT;
+    block = coalesce(block);
+
+    // Only possible after misaligned slack: park this block and grow again,
+    // which continues the same region.
+    if (get_size(block) < size)
+    {
+        list_insert(block);
+        return extend(size);
+    }
+    return block;
+}
+
+/*
+ * split - splits a given block in parts, one allocated, one free. The
+ * remainder is merged with a free successor and goes back on its free list
+ * if it is big enough to be a block. It is known zero if the block was.
+ */
+mem_block_header_t *split(mem_block_header_t *block, size_t new_block_size)
+{
+    size_t size = get_size(block);
+    if (size - new_block_size < MIN_BLOCK_SIZE)
+    {
+        return block;
+    }
+
+    STAT_ADD(splits, 1);
+    TRACE_FLAG(UEVENT_SPLIT);
+    block->block_metadata = new_block_size | (block->block_metadata & ~SIZE_MASK);
+    mem_block_header_t *rest = next_block(block);
+    set_block_metadata(rest, size - new_block_size, false);
+    rest->block_metadata |= block->block_metadata & ZERO_BIT;
+    list_insert(coalesce(rest));
+    return block;
+}
+
+void print(int bin) {
+    if (free_heads[bin] != NULL) {
+        mem_block_header_t* temp1 = free_heads[bin];
+        do {
+            // address : size : allocation status : prev : next
+            printf("      %p : %ld : %d : %p : %p\n",
+                    temp1, get_size(temp1), is_allocated(temp1), temp1->prev, temp1->next);
+            temp1 = temp1->next;
+        } while (temp1);
+        printf("End New\n");
+    }
+    else {
+        printf("free_head[bin] was null\n");
+    }
+}
+
+/*
+ * clear_seam - zeroes the footer, header and links left inside a merged
+ * block where the block that starts at seam used to begin.
+ */
+static void clear_seam(char *seam)
+{
+    memset(seam - sizeof(size_t), 0, sizeof(size_t) + sizeof(mem_block_header_t));
+}
+
+/*
+ * coalesce - coalesces a free memory block with neighbors. The block must be
+ * off the free lists; free neighbours are unlinked and absorbed. Returns the
+ * merged block with its footer written and its successor marked PREV_FREE.
+ * The merged block stays known zero if every part was, at the cost of
+ * clearing the seams between them.
+ */
+mem_block_header_t *coalesce(mem_block_header_t *block)
+{
+    size_t size = get_size(block);
+    size_t zero = block->block_metadata & ZERO_BIT;
+    mem_block_header_t *next = next_block(block);
+
+    if (!is_allocated(next))
+    {
+        STAT_ADD(coalesces, 1);
+        TRACE_FLAG(UEVENT_COALESCE);
+        list_remove(next);
+        size += get_size(next);
+        if (zero && (next->block_metadata & ZERO_BIT))
+        {
+            clear_seam((char *) next);
+        }
+        else
+        {
+            zero = 0;
+        }
+    }
+
+    if (block->block_metadata & PREV_FREE)
+    {
+        STAT_ADD(coalesces, 1);
+        TRACE_FLAG(UEVENT_COALESCE);
+        size_t prev_size = *((size_t *) block - 1);
+        mem_block_header_t *prev = (mem_block_header_t *) ((char *) block - prev_size);
+        list_remove(prev);
+        size += prev_size;
+        if (zero && (prev->block_metadata & ZERO_BIT))
+        {
+            clear_seam((char *) block);
+        }
+        else
+        {
+            zero = 0;
+        }
+        block = prev;
+    }
+
+    set_block_metadata(block, size, false);
+    block->block_metadata |= zero;
+    set_footer(block);
+    set_prev_free(next_block(block), true);
+    return block;
+}
+
+/*
+ * clear_heap - empties the free lists, the tree and the slabs and starts
+ * the counters over. Blocks left in thread caches from an earlier heap are
+ * discarded the next time their thread allocates. Caller holds heap_lock.
+ */
+static void clear_heap()
+{
+    heap_generation++;
+    memset(&stats, 0, sizeof(stats));
+    for (int i = 0; i < BIN_COUNT; i++)
+    {
+        free_heads[i] = NULL;
+    }
+    for (int i = 0; i < BITMAP_WORDS; i++)
+    {
+        bin_bitmap[i] = 0;
+    }
+    free_tree = NULL;
+    memset(slab_pages, 0, slab_pages_used * sizeof(uint64_t));
+    slab_pages_used = 0;
+    for (int i = 0; i < SLAB_CLASSES; i++)
+    {
+        slab_partial[i] = NULL;
+        slab_demand[i] = 0;
+    }
+}
+
+/*
+ * uinit - Used initialize metadata required to manage the heap
+ * along with allocating initial memory. Slabs from an earlier heap are
+ * dropped, and so is the memory of the heap itself; ureset keeps it.
+ */
+int uinit()
+{
+    pthread_mutex_lock(&heap_lock);
+    clear_heap();
+    heap_end = NULL;
+    heap_epilogue = NULL;
+    region_count = 0;
+    auto_trim_floor = 0;
+    auto_trimmed = 0;
+
+    mem_block_header_t *block = extend(PAGESIZE);
+    if (block != NULL)
+    {
+        list_insert(block);
+    }
+    pthread_mutex_unlock(&heap_lock);
+    return (block == NULL) ? -1 : 0;
+}
+
+/*
+ * ureset - starts the heap over in the memory it already has: every csbrk
+ * region becomes one free block again, as if all of it had been freed, and
+ * the thread caches and slabs are emptied. The break stays where it is, so
+ * a heap that is reset and used the same way again reuses the same pages
+ * instead of growing. Blocks still allocated from the heap are lost, but
+ * mapped blocks are not, so free those first. No other thread may use
+ * umalloc meanwhile. Starts a heap with uinit if there is none yet.
+ */
+int ureset()
+{
+    if (region_count == 0)
+    {
+        return uinit();
+    }
+
+    pthread_mutex_lock(&heap_lock);
+    size_t heap_bytes = stats.heap_bytes;
+    clear_heap();
+    stats.heap_bytes = heap_bytes;
+    for (size_t i = 0; i < region_count; i++)
+    {
+        mem_block_header_t *block = heap_regions[i].first;
+        mem_block_header_t *epilogue = heap_regions[i].epilogue;
+        if (epilogue > block)
+        {
+            set_block_metadata(block, (char *) epilogue - (char *) block, false);
+            set_footer(block);
+            set_prev_free(epilogue, true);
+            list_insert(block);
+        }
+    }
+    pthread_mutex_unlock(&heap_lock);
+    return 0;
+}
+
+/*
+ * wants_mapping - returns true if a request for size bytes, needing a block
+ * of block_size bytes, gets a mapping of its own.
+ */
+static bool wants_mapping(size_t size, size_t block_size)
+{
+    return size >= __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED) || block_size + EPILOGUE_SIZE > CSBRK_MAX;
+}
+
+/*
+ * map_block - serves a large request with a mapping of its own whose payload
+ * is aligned to align bytes. The header sits right in front of the payload,
+ * so the pages in front of it that an alignment above ALIGNMENT skips are
+ * unmapped again, as is the slack at the end.
+ */
+static mem_block_header_t *map_block(size_t block_size, size_t align)
+{
+    size_t bytes = PAGE_ROUND(block_size + align - HEADER_SIZE);
+    if (bytes > SIZE_MASK)
+    {
+        return NULL;
+    }
+
+    char *mem = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    uintptr_t payload = ((uintptr_t) mem + HEADER_SIZE + align - 1) & ~((uintptr_t) align - 1);
+    mem_block_header_t *block = get_block((void *) payload);
+    char *start = (char *) ((uintptr_t) block & ~((uintptr_t) PAGESIZE - 1));
+    char *end = (char *) PAGE_ROUND((uintptr_t) block + block_size);
+    if (start > mem)
+    {
+        munmap(mem, start - mem);
+    }
+    if (end < mem + bytes)
+    {
+        munmap(end, mem + bytes - end);
+    }
+    __atomic_fetch_add(&mmap_bytes, end - start, __ATOMIC_RELAXED);
+    TRACE_FLAG(UEVENT_MAPPED);
+
+    block->block_metadata = ((end - (char *) block) & SIZE_MASK) | MMAP_BIT | ALLOC_BIT;
+    return block;
+}
+
+/*
+ * unmap_block - gives a mapped block, and the start of the page it is on,
+ * back to the OS.
+ */
+static void unmap_block(mem_block_header_t *block)
+{
+    char *start = (char *) ((uintptr_t) block & ~((uintptr_t) PAGESIZE - 1));
+    size_t bytes = PAGE_ROUND((uintptr_t) block + get_size(block)) - (uintptr_t) start;
+    __atomic_fetch_sub(&mmap_bytes, bytes, __ATOMIC_RELAXED);
+    munmap(start, bytes);
+}
+
+/*
+ * remap_block - resizes a mapped block whose payload is the first aligned
+ * address on its page to hold block_size bytes, moving it only if the
+ * kernel cannot grow it where it is. Returns NULL, leaving the block
+ * untouched, if the mapping cannot be resized.
+ */
+static mem_block_header_t *remap_block(mem_block_header_t *block, size_t block_size)
+{
+    size_t offset = ALIGNMENT - HEADER_SIZE;
+    size_t old_bytes = PAGE_ROUND(offset + get_size(block));
+    size_t bytes = PAGE_ROUND(offset + block_size);
+    if (bytes == old_bytes)
+    {
+        return block;
+    }
+    if (bytes > SIZE_MASK)
+    {
+        return NULL;
+    }
+
+    char *mem = mremap((char *) block - offset, old_bytes, bytes, MREMAP_MAYMOVE);
+    if (mem == MAP_FAILED)
+    {
+        return NULL;
+    }
+    __atomic_fetch_add(&mmap_bytes, bytes - old_bytes, __ATOMIC_RELAXED);
+
+    block = (mem_block_header_t *) (mem + offset);
+    block->block_metadata = ((bytes - offset) & SIZE_MASK) | MMAP_BIT | ALLOC_BIT;
+    return block;
+}
+
+/*
+ * uset_mmap_threshold - sets the request size from which umalloc maps
+ * blocks on their own, and returns the previous threshold. Requests too
+ * large for a single csbrk call are always mapped.
+ */
+size_t uset_mmap_threshold(size_t threshold)
+{
+    return __atomic_exchange_n(&mmap_threshold, threshold, __ATOMIC_RELAXED);
+}
+
+/*
+ * uset_trim_threshold - sets how many bytes past TRIM_PAD the free block at
+ * the top of the heap may hold before it is trimmed as it forms, and returns
+ * the previous threshold. SIZE_MAX leaves trimming to utrim.
+ */
+size_t uset_trim_threshold(size_t threshold)
+{
+    return __atomic_exchange_n(&trim_threshold, threshold, __ATOMIC_RELAXED);
+}
+
+/*
+ * is_mapped - returns true if payload..payload+size lies inside a block
+ * umalloc mapped on its own. Lets the runner accept payloads that are not
+ * in the csbrk heap.
+ */
+bool is_mapped(void *payload, size_t size)
+{
+    mem_block_header_t *block = get_block(payload);
+    return (block->block_metadata & (MMAP_BIT | ALLOC_BIT)) == (MMAP_BIT | ALLOC_BIT)
+        && (char *) payload + size <= (char *) block + get_size(block);
+}
+
+/*
+ * trim_top - gives everything but pad bytes of the free block at the top of
+ * the heap back with a negative csbrk. Only possible while the break still
+ * ends the heap. The block must be off the free lists; returns it, shrunk
+ * if anything was released, or NULL if it was released whole. The partial
+ * page left above the new break is cleared so a later extend can still
+ * treat the memory it gets back as zero. Caller holds heap_lock.
+ */
+static mem_block_header_t *trim_top(mem_block_header_t *block, size_t pad)
+{
+    size_t keep = (pad == 0) ? 0 : ALIGN(pad);
+    if (keep != 0 && keep < MIN_BLOCK_SIZE)
+    {
+        keep = MIN_BLOCK_SIZE;
+    }
+    if (next_block(block) != heap_epilogue || keep >= get_size(block) || sbrk(0) != heap_end)
+    {
+        return block;
+    }
+
+    mem_block_header_t *epilogue = (mem_block_header_t *) ((char *) block + keep);
+    char *end = (char *) epilogue + HEADER_SIZE;
+    if (PAGE_ROUND((uintptr_t) end) >= PAGE_ROUND((uintptr_t) heap_end) || csbrk(end - heap_end) == (void *) -1)
+    {
+        return block;
+    }
+    memset(end, 0, PAGE_ROUND((uintptr_t) end) - (uintptr_t) end);
+    STAT_ADD(heap_bytes, end - heap_end);
+    heap_end = end;
+    heap_epilogue = epilogue;
+    set_block_metadata(epilogue, 0, true);
+    heap_regions[region_count - 1].epilogue = epilogue;
+    if (keep == 0)
+    {
+        return NULL;
+    }
+
+    block->block_metadata = keep | (block->block_metadata & ~SIZE_MASK);
+    set_footer(block);
+    set_prev_free(epilogue, true);
+    return block;
+}
+
+/*
+ * advise_block - lets the kernel drop the whole pages inside a free block,
+ * past its header and links, tree links included, and before its footer.
+ * They read back as zero, so the block's ZERO_BIT stays valid either way.
+ * Returns the bytes advised.
+ */
+static size_t advise_block(mem_block_header_t *block)
+{
+    uintptr_t start = PAGE_ROUND((uintptr_t) block + FREE_LINKS);
+    uintptr_t end = ((uintptr_t) block + get_size(block) - sizeof(size_t)) & ~((uintptr_t) PAGESIZE - 1);
+    if (end <= start || madvise((void *) start, end - start, MADV_DONTNEED) != 0)
+    {
+        return 0;
+    }
+    return end - start;
+}
+
+/*
+ * put_free - files a coalesced free block on its free list. The free block
+ * at the top of the heap is first cut down to TRIM_PAD bytes once it holds
+ * more than trim_threshold bytes past them, and more than any top block
+ * trimmed before whose memory the heap had to grow back into, so a heap
+ * that keeps shrinking and regrowing by the same amount stops trimming.
+ * Free blocks elsewhere keep their pages until utrim. Caller holds
+ * heap_lock.
+ */
+static void put_free(mem_block_header_t *block)
+{
+    size_t size = get_size(block);
+    if (size > TRIM_PAD && size - TRIM_PAD > __atomic_load_n(&trim_threshold, __ATOMIC_RELAXED)
+        && size > auto_trim_floor && next_block(block) == heap_epilogue)
+    {
+        block = trim_top(block, TRIM_PAD);
+        if (block == NULL || get_size(block) < size)
+        {
+            auto_trimmed = size;
+        }
+        if (block == NULL)
+        {
+            return;
+        }
+    }
+    list_insert(block);
+}
+
+/*
+ * heap_alloc - carves a block of block_size bytes out of the shared heap and
+ * marks it allocated. If zeroed is not NULL it is set when the block's payload
+ * is known zero apart from its links and last word. Caller holds heap_lock.
+ */
+static mem_block_header_t *heap_alloc(size_t block_size, bool *zeroed)
+{
+    mem_block_header_t *block = find(block_size);
+    if (block != NULL)
+    {
+        list_remove(block);
+    }
+    else if ((block = extend(block_size)) == NULL)
+    {
+        return NULL;
+    }
+
+    split(block, block_size);
+    if (zeroed != NULL)
+    {
+        *zeroed = block->block_metadata & ZERO_BIT;
+    }
+    block->block_metadata &= ~ZERO_BIT;
+    allocate(block);
+    set_prev_free(next_block(block), false);
+    return block;
+}
+
+/*
+ * heap_alloc_run - carves up to count blocks of block_size bytes back to back
+ * out of a single free block, or a fresh one from extend, storing their
+ * payloads in out. Any space left over goes back on the free lists. Returns
+ * how many blocks were carved, 0 if the heap is out of memory. Caller holds
+ * heap_lock.
+ */
+static size_t heap_alloc_run(size_t block_size, size_t count, void **out)
+{
+    size_t most = (CSBRK_MAX - EPILOGUE_SIZE) / block_size;
+    if (count > most)
+    {
+        count = most;
+    }
+
+    size_t want = block_size * count;
+    mem_block_header_t *block = find(want);
+    if (block == NULL)
+    {
+        block = find(block_size);
+    }
+    if (block != NULL)
+    {
+        list_remove(block);
+    }
+    else if ((block = extend(want)) == NULL)
+    {
+        return 0;
+    }
+
+    size_t size = get_size(block);
+    size_t flags = block->block_metadata & (PREV_FREE | ZERO_BIT);
+    if (size / block_size < count)
+    {
+        count = size / block_size;
+    }
+
+    mem_block_header_t *last = NULL;
+    for (size_t i = 0; i < count; i++)
+    {
+        last = (mem_block_header_t *) ((char *) block + i * block_size);
+        last->block_metadata = block_size | ALLOC_BIT | (i == 0 ? flags & PREV_FREE : 0);
+        out[i] = get_payload(last);
+    }
+
+    size_t rest = size - count * block_size;
+    if (rest < MIN_BLOCK_SIZE)
+    {
+        last->block_metadata += rest;
+        set_prev_free(next_block(last), false);
+    }
+    else
+    {
+        mem_block_header_t *tail = next_block(last);
+        set_block_metadata(tail, rest, false);
+        tail->block_metadata |= flags & ZERO_BIT;
+        list_insert(coalesce(tail));
+    }
+    return count;
+}
+
+/*
+ * aligned_payload - returns the first payload address in block that is a
+ * multiple of align and leaves either nothing or room for a whole block in
+ * front of it.
+ */
+static uintptr_t aligned_payload(mem_block_header_t *block, size_t align)
+{
+    uintptr_t payload = (uintptr_t) get_payload(block);
+    uintptr_t aligned = (payload + align - 1) & ~((uintptr_t) align - 1);
+    if (aligned != payload && aligned - payload < MIN_BLOCK_SIZE)
+    {
+        aligned += align;
+    }
+    return aligned;
+}
+
+/*
+ * find_aligned - looks for a free block that holds a block of block_size
+ * bytes at an aligned payload, probing FIT_PROBES blocks in each non-empty
+ * class from block_size's up. Any class past block_size + align +
+ * MIN_BLOCK_SIZE fits, so the search stops there at the latest. Returns NULL
+ * if nothing fits.
+ */
+static mem_block_header_t *find_aligned(size_t block_size, size_t align)
+{
+    for (int bin = next_nonempty_bin(size_class(block_size)); bin >= 0; bin = next_nonempty_bin(bin + 1))
+    {
+        int probes = 0;
+        for (mem_block_header_t *block = free_heads[bin]; block != NULL && probes < FIT_PROBES; block = block->next)
+        {
+            uintptr_t gap = aligned_payload(block, align) - (uintptr_t) get_payload(block);
+            if (gap + block_size <= get_size(block))
+            {
+                return block;
+            }
+            probes++;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * heap_alloc_aligned - carves a block of block_size bytes whose payload is a
+ * multiple of align out of the shared heap. A free block that fits at
+ * an aligned payload is used if one turns up, otherwise a block with room
+ * for any alignment is allocated. The fragment in front of the aligned
+ * payload goes back on the free lists and split returns the tail. Caller
+ * holds heap_lock.
+ */
+static mem_block_header_t *heap_alloc_aligned(size_t block_size, size_t align)
+{
+    mem_block_header_t *block = find_aligned(block_size, align);
+    if (block != NULL)
+    {
+        list_remove(block);
+        block->block_metadata &= ~ZERO_BIT;
+        allocate(block);
+        set_prev_free(next_block(block), false);
+    }
+    else if ((block = heap_alloc(block_size + align + MIN_BLOCK_SIZE, NULL)) == NULL)
+    {
+        return NULL;
+    }
+
+    uintptr_t payload = (uintptr_t) get_payload(block);
+    uintptr_t aligned = aligned_payload(block, align);
+    if (aligned != payload)
+    {
+        mem_block_header_t *lead = block;
+        size_t gap = aligned - payload;
+        block = get_block((void *) aligned);
+        block->block_metadata = (get_size(lead) - gap) | ALLOC_BIT;
+        lead->block_metadata = gap | (lead->block_metadata & PREV_FREE);
+        list_insert(coalesce(lead));
+    }
+
+    split(block, block_size);
+    set_prev_free(next_block(block), false);
+    return block;
+}
+
+/*
+ * heap_resize - resizes an allocated heap block to block_size bytes, keeping
+ * its payload. Shrinking splits off the tail; growing absorbs a free
+ * successor and, at the top of the heap, extends the heap into it. If that is
+ * not enough, a free predecessor is absorbed as well and the payload slides
+ * down into it. Returns the resized block, or NULL if neighbouring free space
+ * cannot hold it. Caller holds heap_lock.
+ */
+static mem_block_header_t *heap_resize(mem_block_header_t *block, size_t block_size)
+{
+    size_t size = get_size(block);
+    if (block_size <= size)
+    {
+        split(block, block_size);
+        set_prev_free(next_block(block), false);
+        return block;
+    }
+
+    mem_block_header_t *next = next_block(block);
+    size_t spare = is_allocated(next) ? 0 : get_size(next);
+    mem_block_header_t *top = (spare != 0) ? next_block(next) : next;
+    if (size + spare < block_size && top == heap_epilogue)
+    {
+        // A contiguous region merges with a free successor, so the new
+        // block starts right behind this one.
+        mem_block_header_t *more = extend(block_size - size - spare);
+        if (more == next)
+        {
+            spare = get_size(more);
+            list_insert(more);
+        }
+        else if (more != NULL)
+        {
+            list_insert(more);
+        }
+    }
+
+    size_t prev_size = (block->block_metadata & PREV_FREE) ? *((size_t *) block - 1) : 0;
+    if (size + spare < block_size && prev_size + size + spare < block_size)
+    {
+        return NULL;
+    }
+
+    if (spare != 0)
+    {
+        list_remove(next);
+    }
+    if (size + spare < block_size)
+    {
+        // The payload may slide over this block's own header, so take its
+        // flags first.
+        mem_block_header_t *prev = (mem_block_header_t *) ((char *) block - prev_size);
+        size_t flags = block->block_metadata & ~(SIZE_MASK | PREV_FREE);
+        list_remove(prev);
+        prev->block_metadata = flags | (prev->block_metadata & PREV_FREE);
+        memmove(get_payload(prev), get_payload(block), size - HEADER_SIZE);
+        block = prev;
+        size += prev_size;
+    }
+    block->block_metadata = (size + spare) | (block->block_metadata & ~SIZE_MASK);
+
+    split(block, block_size);
+    set_prev_free(next_block(block), false);
+    return block;
+}
+
+/*
+ * heap_free - returns an allocated block to the shared heap. Caller holds
+ * heap_lock.
+ */
+static void heap_free(mem_block_header_t *block)
+{
+    deallocate(block);
+    put_free(coalesce(block));
+}
+
+/*
+ * slab_link - puts a slab on the front of its class's list.
+ */
+static void slab_link(slab_t *slab)
+{
+    slab->prev = NULL;
+    slab->next = slab_partial[slab->class_id];
+    if (slab->next != NULL)
+    {
+        slab->next->prev = slab;
+    }
+    slab_partial[slab->class_id] = slab;
+}
+
+/*
+ * slab_unlink - takes a slab off its class's list.
+ */
+static void slab_unlink(slab_t *slab)
+{
+    if (slab->prev != NULL)
+    {
+        slab->prev->next = slab->next;
+    }
+    else
+    {
+        slab_partial[slab->class_id] = slab->next;
+    }
+    if (slab->next != NULL)
+    {
+        slab->next->prev = slab->prev;
+    }
+}
+
+/*
+ * slab_mark - sets or clears a page's bit in slab_pages.
+ */
+static void slab_mark(size_t page, bool slab)
+{
+    uint64_t word = slab_pages[page / 64];
+    word = slab ? word | (1ULL << (page % 64)) : word & ~(1ULL << (page % 64));
+    __atomic_store_n(&slab_pages[page / 64], word, __ATOMIC_RELAXED);
+    if (page / 64 >= slab_pages_used)
+    {
+        slab_pages_used = page / 64 + 1;
+    }
+}
+
+/*
+ * slab_new - carves a page-sized block with a page-aligned payload out of
+ * the heap and sets it up as a slab for one class. Returns NULL if the heap
+ * is out of memory or the page lies beyond SLAB_SPAN. Caller holds
+ * heap_lock.
+ */
+static slab_t *slab_new(int class_id)
+{
+    // Growing by several pages at once keeps slabs packed even when other
+    // users of the break split the heap into many regions.
+    if (find_aligned(PAGESIZE, PAGESIZE) == NULL)
+    {
+        mem_block_header_t *more = extend(SLAB_GROW);
+        if (more != NULL)
+        {
+            list_insert(more);
+        }
+    }
+    mem_block_header_t *block = heap_alloc_aligned(PAGESIZE, PAGESIZE);
+    if (block == NULL)
+    {
+        return NULL;
+    }
+    slab_t *slab = get_payload(block);
+    size_t page = slab_page(slab);
+    if (page == SLAB_SPAN / PAGESIZE)
+    {
+        heap_free(block);
+        return NULL;
+    }
+    slab_mark(page, true);
+
+    slab->class_id = class_id;
+    slab->obj_size = (class_id + 1) * ALIGNMENT;
+    slab->capacity = (PAGESIZE - HEADER_SIZE - SLAB_HEADER) / slab->obj_size; // the next header ends the page
+    slab->free_count = slab->capacity;
+    for (int i = 0; i < SLAB_MAP_WORDS; i++)
+    {
+        int bits = slab->capacity - i * 64;
+        slab->free_map[i] = (bits >= 64) ? ~0ULL : (bits <= 0) ? 0 : (1ULL << bits) - 1;
+    }
+    slab_link(slab);
+    return slab;
+}
+
+/*
+ * slab_alloc - hands out the first free object of the first slab of a
+ * class with room, setting up a new slab if there is none. Returns NULL if
+ * no slab can be set up. Caller holds heap_lock.
+ */
+static void *slab_alloc(int class_id)
+{
+    slab_t *slab = slab_partial[class_id];
+    if (slab == NULL && (slab = slab_new(class_id)) == NULL)
+    {
+        return NULL;
+    }
+
+    int word = 0;
+    while (slab->free_map[word] == 0)
+    {
+        word++;
+    }
+    int index = word * 64 + __builtin_ctzll(slab->free_map[word]);
+    slab->free_map[word] &= slab->free_map[word] - 1;
+    if (--slab->free_count == 0)
+    {
+        slab_unlink(slab);
+    }
+    return (char *) slab + SLAB_HEADER + index * slab->obj_size;
+}
+
+/*
+ * slab_free - marks an object free in its slab. A slab that empties while
+ * its class has another slab with room goes back to the heap as an ordinary
+ * free block. Caller holds heap_lock.
+ */
+static void slab_free(void *ptr)
+{
+    slab_t *slab = slab_of(ptr);
+    int index = ((char *) ptr - (char *) slab - SLAB_HEADER) / slab->obj_size;
+
+    slab->free_map[index / 64] |= 1ULL << (index % 64);
+    if (slab->free_count++ == 0)
+    {
+        slab_link(slab);
+    }
+    if (slab->free_count == slab->capacity && (slab_partial[slab->class_id] != slab || slab->next != NULL))
+    {
+        slab_unlink(slab);
+        slab_mark(slab_page(slab), false);
+        heap_free(get_block(slab));
+    }
+}
+
+/*
+ * slab_class - returns the slab class that serves a request for size bytes,
+ * or -1 if size is too large for slabs or its class has not yet seen
+ * SLAB_MIN_DEMAND requests. count requests are added to the class's tally
+ * until then.
+ */
+static int slab_class(size_t size, size_t count)
+{
+    if (size == 0 || size > SLAB_MAX_SIZE)
+    {
+        return -1;
+    }
+    int class_id = ALIGN(size) / ALIGNMENT - 1;
+    if (__atomic_load_n(&slab_demand[class_id], __ATOMIC_RELAXED) >= SLAB_MIN_DEMAND)
+    {
+        return class_id;
+    }
+    __atomic_fetch_add(&slab_demand[class_id], count, __ATOMIC_RELAXED);
+    return -1;
+}
+
+/*
+ * shared_alloc - hands out a payload for a block of block_size bytes: an
+ * object from a slab of class_id unless that is negative or no slab can be
+ * set up, otherwise a block carved from the shared heap. Caller holds
+ * heap_lock.
+ */
+static void *shared_alloc(int class_id, size_t block_size)
+{
+    if (class_id >= 0)
+    {
+        void *payload = slab_alloc(class_id);
+        if (payload != NULL)
+        {
+            return payload;
+        }
+    }
+    mem_block_header_t *block = heap_alloc(block_size, NULL);
+    return (block == NULL) ? NULL : get_payload(block);
+}
+
+/*
+ * tcache_push - puts an allocated payload on one of the cache's magazines.
+ */
+static void tcache_push(tcache_t *cache, int bin, void *payload)
+{
+    *(void **) payload = cache->bins[bin];
+    cache->bins[bin] = payload;
+    cache->counts[bin]++;
+}
+
+/*
+ * tcache_drain - hands up to count cached blocks of one class back to the
+ * shared heap under a single lock.
+ */
+static void tcache_drain(tcache_t *cache, int bin, int count)
+{
+    pthread_mutex_lock(&heap_lock);
+    while (count-- > 0 && cache->counts[bin] > 0)
+    {
+        void *payload = cache->bins[bin];
+        cache->bins[bin] = *(void **) payload;
+        cache->counts[bin]--;
+        if (in_slab(payload))
+        {
+            slab_free(payload);
+        }
+        else
+        {
+            heap_free(get_block(payload));
+        }
+    }
+    pthread_mutex_unlock(&heap_lock);
+}
+
+/*
+ * tcache_collect - takes every block other threads have freed into this
+ * cache, then drains any magazine that overflowed.
+ */
+static void tcache_collect(tcache_t *cache)
+{
+    void *payload = atomic_exchange_explicit(&cache->remote_frees, NULL, memory_order_acquire);
+    while (payload != NULL)
+    {
+        void *next = *(void **) payload;
+        tcache_push(cache, size_class(get_size(get_block(payload))), payload);
+        payload = next;
+    }
+
+    for (int bin = 0; bin < TCACHE_BINS; bin++)
+    {
+        if (cache->counts[bin] > TCACHE_MAX)
+        {
+            tcache_drain(cache, bin, cache->counts[bin] - TCACHE_MAX);
+        }
+    }
+}
+
+/*
+ * remote_free - lets a thread that does not own a cached block give it back
+ * to its owner without taking any lock.
+ */
+static void remote_free(tcache_t *owner, void *payload)
+{
+    void *head = atomic_load_explicit(&owner->remote_frees, memory_order_relaxed);
+    do
+    {
+        *(void **) payload = head;
+    } while (!atomic_compare_exchange_weak_explicit(&owner->remote_frees, &head, payload,
+                                                    memory_order_release, memory_order_relaxed));
+}
+
+/*
+ * tcache_release - pthread key destructor; flushes an exiting thread's cache
+ * and gives it up for the next thread to claim. Blocks freed into it after
+ * this point wait on remote_frees for that thread.
+ */
+static void tcache_release(void *arg)
+{
+    tcache_t *cache = arg;
+    if (cache->generation == heap_generation)
+    {
+        tcache_collect(cache);
+        for (int bin = 0; bin < TCACHE_BINS; bin++)
+        {
+            tcache_drain(cache, bin, cache->counts[bin]);
+        }
+    }
+    atomic_store_explicit(&cache->active, false, memory_order_release);
+    tcache = NULL;
+}
+
+static void tcache_key_init(void)
+{
+    pthread_key_create(&tcache_key, tcache_release);
+}
+
+/*
+ * tcache_claim - binds an unused cache to the calling thread.
+ */
+static tcache_t *tcache_claim(void)
+{
+    pthread_once(&tcache_key_once, tcache_key_init);
+
+    tcache_t *cache = NULL;
+    pthread_mutex_lock(&heap_lock);
+    for (int i = 0; i < TCACHE_COUNT && cache == NULL; i++)
+    {
+        if (!atomic_load_explicit(&tcaches[i].active, memory_order_relaxed))
+        {
+            cache = &tcaches[i];
+            atomic_store_explicit(&cache->active, true, memory_order_release);
+        }
+    }
+    pthread_mutex_unlock(&heap_lock);
+
+    if (cache == NULL)
+    {
+        tcache_unavailable = true;
+        return NULL;
+    }
+    pthread_setspecific(tcache_key, cache);
+    return tcache = cache;
+}
+
+/*
+ * get_tcache - returns the calling thread's cache, emptying it if it was
+ * filled before the last uinit or ureset. Returns NULL when every cache is
+ * taken.
+ */
+static tcache_t *get_tcache(void)
+{
+    tcache_t *cache = tcache;
+    if (cache == NULL && (tcache_unavailable || (cache = tcache_claim()) == NULL))
+    {
+        return NULL;
+    }
+
+    if (cache->generation != heap_generation)
+    {
+        memset(cache->bins, 0, sizeof(cache->bins));
+        memset(cache->counts, 0, sizeof(cache->counts));
+        atomic_store_explicit(&cache->remote_frees, NULL, memory_order_relaxed);
+        cache->generation = heap_generation;
+    }
+    return cache;
+}
+
+/*
+ * tcache_refill - moves up to TCACHE_BATCH fresh blocks of block_size bytes
+ * into magazine bin under a single lock: objects from slabs for a slab
+ * class, blocks from the shared heap otherwise, which are tagged with the
+ * cache's id.
+ */
+static void tcache_refill(tcache_t *cache, int bin, size_t block_size)
+{
+    size_t owner = (size_t) (cache - tcaches + 1) << OWNER_SHIFT;
+    int class_id = (bin >= TCACHE_CLASSES) ? bin - TCACHE_CLASSES : -1;
+
+    pthread_mutex_lock(&heap_lock);
+    for (int i = 0; i < TCACHE_BATCH; i++)
+    {
+        void *payload = shared_alloc(class_id, block_size);
+        if (payload == NULL)
+        {
+            break;
+        }
+        if (!in_slab(payload))
+        {
+            get_block(payload)->block_metadata |= owner;
+        }
+        tcache_push(cache, bin, payload);
+    }
+    pthread_mutex_unlock(&heap_lock);
+}
+
+#if defined(UMALLOC_STATS) || defined(UMALLOC_TRACE)
+/*
+ * payload_class - returns the size class of the block or slab object at
+ * payload and stores its size in *size. Slab objects count towards the
+ * class of their object size.
+ */
+static int payload_class(void *payload, size_t *size)
+{
+    if (in_slab(payload))
+    {
+        *size = slab_of(payload)->obj_size;
+        return find_bucket(*size);
+    }
+    *size = get_size(get_block(payload));
+    return size_class(*size);
+}
+#endif
+
+#ifdef UMALLOC_STATS
+/*
+ * stat_block - counts the block or slab object at payload as handed out, or
+ * as given back if dir is -1.
+ */
+static void stat_block(void *payload, int dir)
+{
+    if (payload == NULL)
+    {
+        return;
+    }
+    size_t size;
+    int bin = payload_class(payload, &size);
+    __atomic_add_fetch(&stats.live[bin], (size_t) dir, __ATOMIC_RELAXED);
+    STAT_ADD(bytes_in_use, (size_t) dir * size);
+    if (dir > 0)
+    {
+        STAT_ADD(allocs, 1);
+    }
+    else
+    {
+        STAT_ADD(frees, 1);
+    }
+}
+#endif
+
+#ifdef UMALLOC_TRACE
+/*
+ * trace_clock - returns the timestamp counter, or the monotonic clock in ns
+ * where there is none.
+ */
+static inline uint64_t trace_clock(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000UL + now.tv_nsec;
+#endif
+}
+
+/*
+ * trace_write - appends bytes to the trace file, or closes it for good if
+ * that fails.
+ */
+static void trace_write(const void *data, size_t bytes)
+{
+    while (bytes > 0 && trace_fd >= 0)
+    {
+        ssize_t written = write(trace_fd, data, bytes);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            fprintf(stderr, "umalloc: writing the trace failed, tracing stopped\n");
+            close(trace_fd);
+            trace_fd = -1;
+            return;
+        }
+        data = (const char *) data + written;
+        bytes -= written;
+    }
+}
+
+/*
+ * trace_dropped - records that count events of thread were lost.
+ */
+static void trace_dropped(uint16_t thread, size_t count)
+{
+    uevent_t event = {.size = (count > UINT32_MAX) ? UINT32_MAX : count, .thread = thread, .op = UEVENT_DROPPED};
+    trace_write(&event, sizeof(event));
+}
+
+/*
+ * trace_drain - writes out every event in the rings and a record of any
+ * dropped since the last drain. Returns how many events it wrote. Only the
+ * flusher, or trace_stop once it has gone, calls this.
+ */
+static size_t trace_drain(void)
+{
+    size_t drained = 0;
+    int count = atomic_load_explicit(&trace_ring_count, memory_order_acquire);
+
+    for (int i = 0; i < count && i < TRACE_RINGS; i++)
+    {
+        trace_ring_t *ring = atomic_load_explicit(&trace_rings[i], memory_order_acquire);
+        if (ring == NULL)
+        {
+            continue; // still being set up, or its mapping failed
+        }
+
+        size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        while (tail != head)
+        {
+            size_t start = tail % TRACE_RING_EVENTS;
+            size_t events = (head - tail < TRACE_RING_EVENTS - start) ? head - tail : TRACE_RING_EVENTS - start;
+            trace_write(&ring->events[start], events * sizeof(uevent_t));
+            tail += events;
+            drained += events;
+        }
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+
+        size_t dropped = atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+        if (dropped != ring->reported)
+        {
+            trace_dropped(ring->id, dropped - ring->reported);
+            ring->reported = dropped;
+        }
+    }
+
+    size_t lost = atomic_load_explicit(&trace_lost, memory_order_relaxed);
+    if (lost != trace_lost_reported)
+    {
+        trace_dropped(UEVENT_NO_THREAD, lost - trace_lost_reported);
+        trace_lost_reported = lost;
+    }
+    return drained;
+}
+
+/*
+ * trace_flusher - drains the rings until trace_stop, napping whenever they
+ * were all empty.
+ */
+static void *trace_flusher(void *arg)
+{
+    struct timespec nap = {0, TRACE_FLUSH_NS};
+
+    while (!atomic_load_explicit(&trace_stopping, memory_order_acquire))
+    {
+        if (trace_drain() == 0)
+        {
+            nanosleep(&nap, NULL);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * trace_stop - stops the flusher at exit and writes out what it left.
+ */
+static void trace_stop(void)
+{
+    atomic_store_explicit(&trace_stopping, true, memory_order_release);
+    pthread_join(trace_flusher_thread, NULL);
+    trace_drain();
+    if (trace_fd >= 0)
+    {
+        close(trace_fd);
+        trace_fd = -1;
+    }
+}
+
+/*
+ * trace_start - opens the trace file, writes its header and starts the
+ * flusher. Tracing stays off if any of that fails.
+ */
+static void trace_start(void)
+{
+    const char *file = getenv("UMALLOC_TRACE_FILE");
+    uevent_header_t header = {.event_size = sizeof(uevent_t), .bin_count = BIN_COUNT};
+
+    trace_fd = open((file != NULL) ? file : "umalloc.events", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (trace_fd < 0)
+    {
+        perror("umalloc: opening the trace file");
+        return;
+    }
+    memcpy(header.magic, UEVENT_MAGIC, sizeof(header.magic));
+    trace_write(&header, sizeof(header));
+    if (trace_fd >= 0 && pthread_create(&trace_flusher_thread, NULL, trace_flusher, NULL) != 0)
+    {
+        close(trace_fd);
+        trace_fd = -1;
+    }
+    if (trace_fd >= 0)
+    {
+        atexit(trace_stop);
+    }
+}
+
+/*
+ * trace_claim - maps a ring for the calling thread, starting tracing on the
+ * first call. Returns NULL if tracing is off or every ring is taken.
+ */
+static trace_ring_t *trace_claim(void)
+{
+    pthread_once(&trace_once, trace_start);
+
+    int id = atomic_fetch_add_explicit(&trace_ring_count, 1, memory_order_relaxed);
+    trace_ring_t *ring = MAP_FAILED;
+    if (trace_fd >= 0 && id < TRACE_RINGS)
+    {
+        ring = mmap(NULL, sizeof(trace_ring_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (ring == MAP_FAILED)
+    {
+        trace_unavailable = true;
+        return NULL;
+    }
+
+    ring->id = id;
+    atomic_store_explicit(&trace_rings[id], ring, memory_order_release);
+    return trace_ring = ring;
+}
+
+/*
+ * trace_begin - opens the event of a call of type op for size bytes of class
+ * class_id, unless it is made from within another call. Returns how deep
+ * the call is.
+ */
+static int trace_begin(int op, size_t size, int class_id)
+{
+    if (trace_nesting++ == 0)
+    {
+        trace_event = (uevent_t) {.size = (size > UINT32_MAX) ? UINT32_MAX : size, .class_id = class_id, .op = op};
+        trace_event.start = trace_clock();
+    }
+    return trace_nesting;
+}
+
+/*
+ * trace_end - closes the event of the call TRACE_OP opened when it leaves
+ * its block, and pushes the event onto the thread's ring if the call was
+ * the outermost.
+ */
+static void trace_end(int *depth)
+{
+    if (--trace_nesting > 0)
+    {
+        return;
+    }
+
+    uint64_t cycles = trace_clock() - trace_event.start;
+    trace_event.cycles = (cycles > UINT32_MAX) ? UINT32_MAX : cycles;
+
+    trace_ring_t *ring = trace_ring;
+    if (ring == NULL && (trace_unavailable || (ring = trace_claim()) == NULL))
+    {
+        atomic_fetch_add_explicit(&trace_lost, 1, memory_order_relaxed);
+        return;
+    }
+
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) == TRACE_RING_EVENTS)
+    {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    trace_event.thread = ring->id;
+    ring->events[head % TRACE_RING_EVENTS] = trace_event;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+/*
+ * trace_size - returns the size of the block or slab object at payload, for
+ * the event of a free.
+ */
+static size_t trace_size(void *payload)
+{
+    size_t size;
+    payload_class(payload, &size);
+    return size;
+}
+
+/*
+ * trace_class - returns the size class of the block or slab object at
+ * payload, for the event of a free.
+ */
+static int trace_class(void *payload)
+{
+    size_t size;
+    return payload_class(payload, &size);
+}
+#endif
+
+/*
+ * umalloc -  allocates size bytes and returns a pointer to the allocated memory.
+ * Small exact classes come from the calling thread's cache, after it has
+ * collected blocks other threads freed into it, and the smallest sizes come
+ * from its slab class magazines once in demand; large requests are mapped on
+ * their own, and everything else takes heap_lock.
+ */
+void *umalloc(size_t size)
+{
+    TRACE_OP(UEVENT_MALLOC, size, find_bucket(size));
+    size_t block_size = block_size_for(size);
+    if (block_size == 0)
+    {
+        return NULL;
+    }
+
+    if (wants_mapping(size, block_size))
+    {
+        mem_block_header_t *block = map_block(block_size, ALIGNMENT);
+        void *payload = (block == NULL) ? NULL : get_payload(block);
+        STAT_ALLOC(payload);
+        return payload;
+    }
+
+    int bin = size_class(block_size);
+    int class_id = slab_class(size, 1);
+    if (class_id >= 0)
+    {
+        // A heap block standing in for a slab object fits the whole class.
+        bin = SLAB_BIN(class_id);
+        block_size = block_size_for((class_id + 1) * ALIGNMENT);
+    }
+
+    tcache_t *cache;
+    if ((class_id >= 0 || bin < TCACHE_CLASSES) && (cache = get_tcache()) != NULL)
+    {
+        if (atomic_load_explicit(&cache->remote_frees, memory_order_relaxed) != NULL)
+        {
+            tcache_collect(cache);
+        }
+        if (cache->counts[bin] == 0)
+        {
+            tcache_refill(cache, bin, block_size);
+            if (cache->counts[bin] == 0)
+            {
+                return NULL;
+            }
+        }
+        void *payload = cache->bins[bin];
+        cache->bins[bin] = *(void **) payload;
+        cache->counts[bin]--;
+        TRACE_FLAG((class_id >= 0) ? UEVENT_CACHED | UEVENT_SLAB : UEVENT_CACHED);
+        STAT_ALLOC(payload);
+        return payload;
+    }
+
+    TRACE_FLAG((class_id >= 0) ? UEVENT_SLAB : 0);
+    pthread_mutex_lock(&heap_lock);
+    void *payload = shared_alloc(class_id, block_size);
+    pthread_mutex_unlock(&heap_lock);
+    STAT_ALLOC(payload);
+    return payload;
+}
+
+/*
+ * release - returns the block at ptr. A cached block goes back to its
+ * owner's magazine, directly or through its remote free list, filed under
+ * bin, or under the class of its header's size if bin is negative. Slab
+ * objects have no owner and go to the calling thread's magazine for their
+ * slab class. A mapped block is unmapped and everything else takes
+ * heap_lock.
+ */
+static void release(void *ptr, int bin)
+{
+    if (in_slab(ptr))
+    {
+        TRACE_FLAG(UEVENT_SLAB);
+        tcache_t *cache = get_tcache();
+        if (cache == NULL)
+        {
+            pthread_mutex_lock(&heap_lock);
+            slab_free(ptr);
+            pthread_mutex_unlock(&heap_lock);
+            return;
+        }
+        bin = SLAB_BIN(slab_of(ptr)->class_id);
+        TRACE_FLAG(UEVENT_CACHED);
+        tcache_push(cache, bin, ptr);
+        if (cache->counts[bin] > TCACHE_MAX)
+        {
+            tcache_drain(cache, bin, TCACHE_BATCH);
+        }
+        return;
+    }
+
+    mem_block_header_t *block = get_block(ptr);
+    if (is_mmapped(block))
+    {
+        unmap_block(block);
+        return;
+    }
+
+    unsigned owner = get_owner(block);
+    if (owner != 0)
+    {
+        tcache_t *cache = get_tcache();
+        tcache_t *home = &tcaches[owner - 1];
+        if (cache == home)
+        {
+            if (bin < 0)
+            {
+                bin = size_class(get_size(block));
+            }
+            TRACE_FLAG(UEVENT_CACHED);
+            tcache_push(cache, bin, ptr);
+            if (cache->counts[bin] > TCACHE_MAX)
+            {
+                tcache_drain(cache, bin, TCACHE_BATCH);
+            }
+            return;
+        }
+        if (atomic_load_explicit(&home->active, memory_order_acquire))
+        {
+            remote_free(home, ptr);
+            return;
+        }
+    }
+
+    pthread_mutex_lock(&heap_lock);
+    heap_free(block);
+    pthread_mutex_unlock(&heap_lock);
+}
+
+/**
+ * @param ptr the pointer to the memory to be freed,
+ * must have been called by a previous malloc call
+ * @brief frees the memory space pointed to by ptr. A cached block goes back
+ * to its owner's magazine, directly or through its remote free list, and a
+ * mapped block is unmapped.
+ */
+void ufree(void *ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+    TRACE_OP(UEVENT_FREE, trace_size(ptr), trace_class(ptr));
+    STAT_FREE(ptr);
+    release(ptr, -1);
+}
+
+/*
+ * ufree_sized - frees ptr like ufree, given the size it was last allocated
+ * or reallocated with. A cached block is filed under the class of that size
+ * instead of the one its header decodes to; the class can only be smaller,
+ * since a block is never smaller than its request, so the magazine stays
+ * sound. Slab objects always go back to their own slab class. Builds with
+ * UMALLOC_DEBUG assert that size fits the block.
+ */
+void ufree_sized(void *ptr, size_t size)
+{
+    if (ptr == NULL) {
+        return;
+    }
+#ifdef UMALLOC_DEBUG
+    if (in_slab(ptr))
+    {
+        assert(size <= slab_of(ptr)->obj_size);
+    }
+    else
+    {
+        assert(block_size_for(size) != 0 && block_size_for(size) <= get_size(get_block(ptr)));
+    }
+#endif
+    TRACE_OP(UEVENT_FREE, trace_size(ptr), trace_class(ptr));
+    STAT_FREE(ptr);
+    release(ptr, find_bucket(size));
+}
+
+/*
+ * urealloc - resizes the block at ptr to hold size bytes and returns its
+ * payload, which keeps the old contents up to the smaller of the two sizes.
+ * Heap blocks shrink and grow into neighbouring free space when they can,
+ * mapped blocks are remapped, and a new block is allocated and copied into
+ * only as a last resort. A NULL ptr allocates, and a size of 0 frees ptr and returns NULL.
+ * Returns NULL and leaves ptr untouched if no block can be found.
+ */
+void *urealloc(void *ptr, size_t size)
+{
+    TRACE_OP(UEVENT_REALLOC, size, find_bucket(size));
+    if (ptr == NULL)
+    {
+        return umalloc(size);
+    }
+    if (size == 0)
+    {
+        ufree(ptr);
+        return NULL;
+    }
+
+    size_t block_size = block_size_for(size);
+    if (block_size == 0)
+    {
+        return NULL;
+    }
+
+    mem_block_header_t *block = get_block(ptr);
+    bool mapped = wants_mapping(size, block_size);
+    if (in_slab(ptr))
+    {
+        if (size <= slab_of(ptr)->obj_size)
+        {
+            return ptr;
+        }
+    }
+    else if (is_mmapped(block))
+    {
+        // Over-aligned mappings start further into their page than mremap
+        // can keep track of.
+        if (mapped && (uintptr_t) get_payload(block) % PAGESIZE == ALIGNMENT)
+        {
+            STAT_FREE(ptr);
+            mem_block_header_t *remapped = remap_block(block, block_size);
+            STAT_ALLOC((remapped == NULL) ? ptr : get_payload(remapped));
+            return (remapped == NULL) ? NULL : get_payload(remapped);
+        }
+    }
+    else if (get_owner(block) != 0)
+    {
+        // Cached blocks have to stay in their class for their magazine.
+        if (block_size <= get_size(block))
+        {
+            return ptr;
+        }
+    }
+    else if (!mapped)
+    {
+        STAT_FREE(ptr);
+        pthread_mutex_lock(&heap_lock);
+        mem_block_header_t *resized = heap_resize(block, block_size);
+        pthread_mutex_unlock(&heap_lock);
+        STAT_ALLOC((resized == NULL) ? ptr : get_payload(resized));
+        if (resized != NULL)
+        {
+            return get_payload(resized);
+        }
+    }
+
+    // A block that has to move to grow is likely to grow again, so it gets a
+    // quarter more room than asked for.
+    size_t old_size = in_slab(ptr) ? slab_of(ptr)->obj_size : get_size(block) - HEADER_SIZE;
+    void *payload = umalloc((size > old_size) ? size + size / 4 : size);
+    if (payload == NULL)
+    {
+        return NULL;
+    }
+    memcpy(payload, ptr, (old_size < size) ? old_size : size);
+    ufree(ptr);
+    return payload;
+}
+
+/*
+ * ucalloc - allocates zeroed memory for nmemb elements of size bytes each.
+ * Returns NULL if nmemb * size overflows. Fresh mappings and blocks carved
+ * from memory that is known zero only have their link words cleared instead
+ * of the whole payload.
+ */
+void *ucalloc(size_t nmemb, size_t size)
+{
+    size_t bytes;
+    if (__builtin_mul_overflow(nmemb, size, &bytes))
+    {
+        return NULL;
+    }
+    TRACE_OP(UEVENT_CALLOC, bytes, find_bucket(bytes));
+
+    size_t block_size = block_size_for(bytes);
+    if (block_size == 0)
+    {
+        return NULL;
+    }
+
+    if (wants_mapping(bytes, block_size))
+    {
+        mem_block_header_t *block = map_block(block_size, ALIGNMENT);
+        void *payload = (block == NULL) ? NULL : get_payload(block);
+        STAT_ALLOC(payload);
+        return payload;
+    }
+
+    if (size_class(block_size) < TCACHE_CLASSES)
+    {
+        void *payload = umalloc(bytes);
+        if (payload != NULL)
+        {
+            memset(payload, 0, bytes);
+        }
+        return payload;
+    }
+
+    bool zeroed;
+    pthread_mutex_lock(&heap_lock);
+    mem_block_header_t *block = heap_alloc(block_size, &zeroed);
+    pthread_mutex_unlock(&heap_lock);
+    if (block == NULL)
+    {
+        return NULL;
+    }
+
+    void *payload = get_payload(block);
+    STAT_ALLOC(payload);
+    if (zeroed)
+    {
+        // The links and, if the block was not split, the old footer.
+        memset(payload, 0, sizeof(mem_block_header_t) - HEADER_SIZE);
+        *(size_t *) ((char *) block + get_size(block) - sizeof(size_t)) = 0;
+    }
+    else
+    {
+        memset(payload, 0, bytes);
+    }
+    return payload;
+}
+
+/*
+ * ualigned_alloc - allocates size bytes whose address is a multiple of align,
+ * which must be a power of two. Alignments up to ALIGNMENT are what umalloc
+ * gives anyway. Larger ones are carved out of a bigger free block, whose
+ * leading fragment is freed again rather than wasted.
+ */
+void *ualigned_alloc(size_t align, size_t size)
+{
+    TRACE_OP(UEVENT_ALIGNED, size, find_bucket(size));
+    if (align == 0 || (align & (align - 1)) != 0 || align > (SIZE_MASK >> 1))
+    {
+        return NULL;
+    }
+    if (align <= ALIGNMENT)
+    {
+        return umalloc(size);
+    }
+
+    size_t block_size = block_size_for(size);
+    if (block_size == 0)
+    {
+        return NULL;
+    }
+
+    mem_block_header_t *block;
+    if (wants_mapping(size, block_size + align + MIN_BLOCK_SIZE))
+    {
+        block = map_block(block_size, align);
+    }
+    else
+    {
+        pthread_mutex_lock(&heap_lock);
+        block = heap_alloc_aligned(block_size, align);
+        pthread_mutex_unlock(&heap_lock);
+    }
+    void *payload = (block == NULL) ? NULL : get_payload(block);
+    STAT_ALLOC(payload);
+    return payload;
+}
+
+/*
+ * umemalign - posix_memalign for umalloc: stores a payload of size bytes
+ * aligned to align bytes in *memptr. Returns EINVAL if align is not a power
+ * of two multiple of sizeof(void *), and ENOMEM if there is no memory.
+ */
+int umemalign(void **memptr, size_t align, size_t size)
+{
+    if (align < sizeof(void *) || (align & (align - 1)) != 0)
+    {
+        return EINVAL;
+    }
+
+    void *payload = ualigned_alloc(align, size);
+    if (payload == NULL)
+    {
+        return ENOMEM;
+    }
+    *memptr = payload;
+    return 0;
+}
+
+/*
+ * umalloc_batch - allocates count blocks of size bytes each, storing their
+ * payloads in out, and returns how many it allocated; fewer than count only
+ * if memory ran out. The size class is worked out once, the calling thread's
+ * cache is emptied first and the rest are carved back to back out of as few
+ * free blocks as possible, or taken from slabs for a slab class in demand,
+ * under a single lock.
+ */
+size_t umalloc_batch(size_t size, size_t count, void **out)
+{
+    size_t block_size = block_size_for(size);
+    size_t n = 0;
+    if (block_size == 0)
+    {
+        return 0;
+    }
+
+    if (wants_mapping(size, block_size))
+    {
+        for (; n < count; n++)
+        {
+            mem_block_header_t *block = map_block(block_size, ALIGNMENT);
+            if (block == NULL)
+            {
+                break;
+            }
+            out[n] = get_payload(block);
+            STAT_ALLOC(out[n]);
+        }
+        return n;
+    }
+
+    int bin = size_class(block_size);
+    int class_id = slab_class(size, count);
+    if (class_id >= 0)
+    {
+        bin = SLAB_BIN(class_id);
+    }
+
+    tcache_t *cache;
+    if ((class_id >= 0 || bin < TCACHE_CLASSES) && (cache = get_tcache()) != NULL)
+    {
+        if (atomic_load_explicit(&cache->remote_frees, memory_order_relaxed) != NULL)
+        {
+            tcache_collect(cache);
+        }
+        for (; n < count && cache->counts[bin] > 0; n++)
+        {
+            out[n] = cache->bins[bin];
+            cache->bins[bin] = *(void **) out[n];
+            cache->counts[bin]--;
+        }
+    }
+
+    pthread_mutex_lock(&heap_lock);
+    if (class_id >= 0)
+    {
+        while (n < count && (out[n] = slab_alloc(class_id)) != NULL)
+        {
+            n++;
+        }
+    }
+    while (n < count)
+    {
+        size_t carved = heap_alloc_run(block_size, count - n, out + n);
+        if (carved == 0)
+        {
+            break;
+        }
+        n += carved;
+    }
+    pthread_mutex_unlock(&heap_lock);
+#ifdef UMALLOC_STATS
+    for (size_t i = 0; i < n; i++)
+    {
+        STAT_ALLOC(out[i]);
+    }
+#endif
+    return n;
+}
+
+/*
+ * heap_free_run - returns the allocated blocks from block up to end, which
+ * lie back to back, to the shared heap as one free block. Caller holds
+ * heap_lock.
+ */
+static void heap_free_run(mem_block_header_t *block, char *end)
+{
+    block->block_metadata = (end - (char *) block) | (block->block_metadata & PREV_FREE);
+    put_free(coalesce(block));
+}
+
+/*
+ * ufree_batch - frees count payloads, skipping NULL ones, under a single
+ * lock. Heap blocks that follow each other in memory, like a run from
+ * umalloc_batch freed in order, are put back on the free lists as one block.
+ * Cached blocks go back to their owner and slab objects to this thread's
+ * magazines as in ufree, and the magazines are drained once at the end.
+ */
+void ufree_batch(void **ptrs, size_t count)
+{
+    tcache_t *cache = get_tcache();
+    mem_block_header_t *run = NULL;
+    char *run_end = NULL;
+
+    pthread_mutex_lock(&heap_lock);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (ptrs[i] == NULL)
+        {
+            continue;
+        }
+        STAT_FREE(ptrs[i]);
+        if (in_slab(ptrs[i]))
+        {
+            if (cache != NULL)
+            {
+                tcache_push(cache, SLAB_BIN(slab_of(ptrs[i])->class_id), ptrs[i]);
+            }
+            else
+            {
+                slab_free(ptrs[i]);
+            }
+            continue;
+        }
+
+        mem_block_header_t *block = get_block(ptrs[i]);
+        unsigned owner = get_owner(block);
+        if (is_mmapped(block))
+        {
+            unmap_block(block);
+        }
+        else if (owner != 0 && &tcaches[owner - 1] == cache)
+        {
+            tcache_push(cache, size_class(get_size(block)), ptrs[i]);
+        }
+        else if (owner != 0 && atomic_load_explicit(&tcaches[owner - 1].active, memory_order_acquire))
+        {
+            remote_free(&tcaches[owner - 1], ptrs[i]);
+        }
+        else if ((char *) block == run_end)
+        {
+            run_end += get_size(block);
+        }
+        else
+        {
+            if (run != NULL)
+            {
+                heap_free_run(run, run_end);
+            }
+            run = block;
+            run_end = (char *) block + get_size(block);
+        }
+    }
+    if (run != NULL)
+    {
+        heap_free_run(run, run_end);
+    }
+    pthread_mutex_unlock(&heap_lock);
+
+    for (int bin = 0; cache != NULL && bin < TCACHE_BINS; bin++)
+    {
+        if (cache->counts[bin] > TCACHE_MAX)
+        {
+            tcache_drain(cache, bin, cache->counts[bin] - TCACHE_MAX);
+        }
+    }
+}
+
+/*
+ * utrim - gives free heap memory back to the system: the free block at the
+ * top of the heap is cut down to pad bytes with a negative csbrk, and the
+ * whole pages inside every other free block are advised away. Returns the
+ * bytes released.
+ */
+size_t utrim(size_t pad)
+{
+    size_t released = 0;
+
+    pthread_mutex_lock(&heap_lock);
+    if (heap_epilogue != NULL && (heap_epilogue->block_metadata & PREV_FREE))
+    {
+        char *end = heap_end;
+        mem_block_header_t *top = (mem_block_header_t *) ((char *) heap_epilogue - *((size_t *) heap_epilogue - 1));
+        list_remove(top);
+        top = trim_top(top, pad);
+        if (top != NULL)
+        {
+            list_insert(top);
+        }
+        released += PAGE_ROUND((uintptr_t) end) - PAGE_ROUND((uintptr_t) heap_end);
+    }
+    for (int bin = next_nonempty_bin(size_class(2 * PAGESIZE)); bin >= 0; bin = next_nonempty_bin(bin + 1))
+    {
+        for (mem_block_header_t *block = free_heads[bin]; block != NULL; block = block->next)
+        {
+            released += advise_block(block);
+        }
+    }
+    pthread_mutex_unlock(&heap_lock);
+    return released;
+}
+
+/*
+ * ustats - fills in out with a snapshot of the allocator: the free lists and
+ * mapped bytes, and the counters kept by UMALLOC_STATS builds. Blocks in
+ * thread caches count as handed out, as the heap sees them.
+ */
+void ustats(struct ustats *out)
+{
+    pthread_mutex_lock(&heap_lock);
+#ifdef UMALLOC_STATS
+    out->counted = true;
+#else
+    out->counted = false;
+#endif
+    out->bytes_in_use = __atomic_load_n(&stats.bytes_in_use, __ATOMIC_RELAXED);
+    out->heap_bytes = stats.heap_bytes;
+    out->mapped_bytes = __atomic_load_n(&mmap_bytes, __ATOMIC_RELAXED);
+    out->allocs = __atomic_load_n(&stats.allocs, __ATOMIC_RELAXED);
+    out->frees = __atomic_load_n(&stats.frees, __ATOMIC_RELAXED);
+    out->splits = stats.splits;
+    out->coalesces = stats.coalesces;
+    out->extends = stats.extends;
+    out->free_bytes = 0;
+    for (int bin = 0; bin < BIN_COUNT; bin++)
+    {
+        out->live[bin] = __atomic_load_n(&stats.live[bin], __ATOMIC_RELAXED);
+        out->free_blocks[bin] = 0;
+        for (mem_block_header_t *block = free_heads[bin]; block != NULL; block = block->next)
+        {
+            out->free_blocks[bin]++;
+            out->free_bytes += get_size(block);
+        }
+    }
+    pthread_mutex_unlock(&heap_lock);
+}
@@ -1,23 +1,175 @@
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #define ALIGNMENT 16 /* The alignment of all payloads returned by umalloc */
 #define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~(ALIGNMENT-1))
-#define BIN_COUNT 4
+
+#define HEADER_SIZE 8      /* bytes in front of every payload */
+#define MIN_BLOCK_SIZE 32  /* header, links and footer of a free block */
+#define EPILOGUE_SIZE 16   /* epilogue header plus the slack that aligns a region's first payload */
+
+/*
+ * Segregated size classes. Block sizes (header included) below
+ * EXACT_CLASS_LIMIT get one exact class per ALIGNMENT bytes, everything at or
+ * above LARGE_CLASS_LIMIT shares the last class, and the classes in between
+ * are generated by gen_classes from the request sizes of a set of traces
+ * (make classes), which gives sizes common there classes of their own.
+ */
+#define LARGE_CLASS_LIMIT (1UL << 16)
+#include "size_classes.h"
+#define BITMAP_WORDS ((BIN_COUNT + 63) / 64)
+
+/*
+ * Requests of at least this many bytes get a mapping of their own that is
+ * unmapped again by ufree. Adjustable with uset_mmap_threshold.
+ */
+#define DEFAULT_MMAP_THRESHOLD (64 * 1024)
+
+/*
+ * Payloads of at most SLAB_MAX_SIZE bytes get slab classes of their own,
+ * one per ALIGNMENT bytes of payload, and are carved from page-sized slabs
+ * without a header of their own once their class is in demand.
+ */
+#define SLAB_MAX_SIZE 128
+#define SLAB_CLASSES (SLAB_MAX_SIZE / ALIGNMENT)
+
+/*
+ * A free block at the top of the heap with more than this many bytes to
+ * spare is cut back with a negative csbrk as it forms. Free memory elsewhere
+ * is only released by utrim. Adjustable with uset_trim_threshold.
+ */
+#define DEFAULT_TRIM_THRESHOLD (128 * 1024)
+
+#define ALLOC_BIT 0x1UL
+#define PREV_FREE 0x2UL    /* the physically preceding block is free */
+#define MMAP_BIT 0x4UL     /* the block is a mapping of its own, not part of the heap */
+#define ZERO_BIT 0x8UL     /* a free block is zero apart from its header, links and footer */
+#define FLAG_MASK 0xFUL
+#define OWNER_SHIFT 48     /* bits [63:48] of an allocated block name its thread cache */
+#define SIZE_MASK (((1UL << OWNER_SHIFT) - 1) & ~FLAG_MASK)
 
 /*
- * mem_block_header_t - Represents a block of memory managed by the heap. The 
+ * mem_block_header_t - Represents a block of memory managed by the heap. The
  * struct can be left as is, or modified for your design.
  * In the current design bit0 is the allocated bit
- * bits 1-3 are unused.
- * and the remaining 60 bit represent the size.
+ * bit1 is set when the block right before this one in memory is free,
+ * bit2 is set when the block was mmapped on its own rather than carved from
+ * the csbrk heap, bit3 is set on a free block that is known to be zero
+ * apart from its header, links and footer, so ucalloc can skip clearing
+ * it.
+ * bits 4-47 represent the size of the whole block, header included,
+ * and bits 48-63 hold the id of the thread cache a small allocated block
+ * belongs to (0 for none).
+ * Free blocks sit on a doubly linked list per size class; next and prev live
+ * in the first two words of the payload, so an allocated block keeps only
+ * its HEADER_SIZE byte header. Blocks start HEADER_SIZE bytes short of an
+ * ALIGNMENT boundary so that their payloads are aligned. Free blocks also
+ * repeat their size in their last word (the footer) so the next block can
+ * find their start.
+ * Every csbrk region ends in an allocated, zero-sized epilogue header.
  */
 typedef struct mem_block_header_struct {
-    size_t block_metadata; // This field stores the block size in bits [63:4], and allocation status in bit 0
-    struct mem_block_header_struct *next;
+    size_t block_metadata; // This field stores the owner in bits [63:48], the block size in bits [47:4], and allocation status in bit 0
+    struct mem_block_header_struct *next; // Only valid while the block is free
+    struct mem_block_header_struct *prev; // Only valid while the block is free
 } mem_block_header_t;
 
-// Helper Functions. Their parameters may be edited if you change their 
+/*
+ * heap_region_t - a csbrk region of the heap, from its first block to the
+ * epilogue that ends it. umalloc records every region in heap_regions, in
+ * the order extend made them, so the heap can be walked block by block
+ * across the gaps other sbrk callers leave between regions.
+ */
+typedef struct heap_region {
+    mem_block_header_t *first;
+    mem_block_header_t *epilogue;
+} heap_region_t;
+
+/*
+ * tree_node_t - the links of a free block in free_tree, a red-black tree of
+ * every free block of at least TREE_MIN_SIZE bytes ordered by size and then
+ * address, which gives best fit past the exact classes. They follow the
+ * block's list links and are cleared when it leaves the tree, so the block
+ * stays zero apart from its header, links and footer.
+ */
+#define TREE_MIN_SIZE EXACT_CLASS_LIMIT
+typedef struct tree_node_struct {
+    struct tree_node_struct *left;
+    struct tree_node_struct *right;
+    struct tree_node_struct *parent;
+    size_t red;
+} tree_node_t;
+
+/*
+ * ustats_t - a snapshot of the allocator, filled in by ustats. The free
+ * lists and mappings are always reported. The rest is counted only by
+ * builds with UMALLOC_STATS (make stats or make debug), reads zero
+ * otherwise, and starts over at every uinit or ureset.
+ */
+typedef struct ustats {
+    bool counted;                  // the counters below were kept
+    size_t bytes_in_use;           // bytes of the blocks handed out, headers included
+    size_t heap_bytes;             // bytes taken from csbrk and not given back
+    size_t mapped_bytes;           // bytes mapped for blocks of their own
+    size_t free_bytes;             // bytes on the free lists
+    size_t live[BIN_COUNT];        // blocks handed out per size class
+    size_t free_blocks[BIN_COUNT]; // free list length per size class
+    uint64_t allocs;               // blocks handed out
+    uint64_t frees;                // blocks given back
+    uint64_t splits;
+    uint64_t coalesces;
+    uint64_t extends;              // csbrk calls that grew the heap
+} ustats_t;
+
+/*
+ * uevent_t - one call into umalloc, recorded by builds with UMALLOC_TRACE
+ * (make tracing). Each thread buffers its events in a ring of its own that
+ * a background thread appends to the file named by UMALLOC_TRACE_FILE
+ * (umalloc.events by default), after a uevent_header_t. Calls made from
+ * within another, such as the umalloc behind a urealloc that moves, fold
+ * into the outer call's event; the batch calls are not recorded.
+ * event_report summarizes the file.
+ */
+#define UEVENT_MAGIC "UMEVENT1"
+
+enum uevent_op {
+    UEVENT_MALLOC,
+    UEVENT_FREE,       // ufree and ufree_sized
+    UEVENT_REALLOC,
+    UEVENT_CALLOC,
+    UEVENT_ALIGNED,    // ualigned_alloc and umemalign
+    UEVENT_DROPPED,    // size events of thread were lost to a full ring, or to no ring at all
+    UEVENT_OPS
+};
+
+#define UEVENT_SPLIT 0x1     // a free block was split
+#define UEVENT_EXTEND 0x2    // the heap grew with csbrk
+#define UEVENT_MAPPED 0x4    // a block got a mapping of its own
+#define UEVENT_CACHED 0x8    // served from or returned to a thread cache
+#define UEVENT_SLAB 0x10     // a slab object
+#define UEVENT_COALESCE 0x20 // a free block merged with a neighbour
+
+#define UEVENT_NO_THREAD UINT16_MAX /* thread of the events lost for want of a ring */
+
+typedef struct uevent {
+    uint64_t start;    // timestamp counter when the call began
+    uint32_t cycles;   // timestamp counter ticks the call took, saturated
+    uint32_t size;     // bytes asked for (saturated); for frees, the size of the block
+    uint16_t class_id; // size class of size
+    uint16_t probes;   // free blocks and tree nodes find examined
+    uint16_t thread;   // the ring the event came through, one per thread
+    uint8_t op;        // enum uevent_op
+    uint8_t flags;     // UEVENT_SPLIT and the rest
+} uevent_t;
+
+typedef struct uevent_header {
+    char magic[8];      // UEVENT_MAGIC, without its NUL
+    uint32_t event_size; // sizeof(uevent_t)
+    uint32_t bin_count;  // BIN_COUNT of the build that wrote the file
+} uevent_header_t;
+
+// Helper Functions. Their parameters may be edited if you change their
 // signature in umalloc.c. Do not change their purpose.
 bool is_allocated(mem_block_header_t *block);
 void allocate(mem_block_header_t *block);
@@ -25,17 +177,31 @@ void deallocate(mem_block_header_t *block);
 size_t get_size(mem_block_header_t *block);
 mem_block_header_t *get_next(mem_block_header_t *block);
 void set_block_metadata(mem_block_header_t *block, size_t size, bool alloc);
-int get_payload(mem_block_header_t *block);
+void *get_payload(mem_block_header_t *block);
 mem_block_header_t *get_block(void *payload);
+int size_class(size_t size);
+int find_bucket(size_t size);
 
 mem_block_header_t *find(size_t size);
-mem_block_header_t *extend(size_t size, int bucketSize);
+mem_block_header_t *extend(size_t size);
 mem_block_header_t *split(mem_block_header_t *block, size_t size);
-mem_block_header_t *coalesce(mem_block_header_t *block, mem_block_header_t* next);
-void orderByAddress(mem_block_header_t* head_ptr, mem_block_header_t* newList, int bin, bool single);
+mem_block_header_t *coalesce(mem_block_header_t *block);
+size_t uset_mmap_threshold(size_t threshold);
+bool is_mapped(void *payload, size_t size);
+void *urealloc(void *ptr, size_t size);
+void *ucalloc(size_t nmemb, size_t size);
+void *ualigned_alloc(size_t align, size_t size);
+int umemalign(void **memptr, size_t align, size_t size);
+size_t umalloc_batch(size_t size, size_t count, void **out);
+void ufree_batch(void **ptrs, size_t count);
+void ufree_sized(void *ptr, size_t size);
+size_t uset_trim_threshold(size_t threshold);
+size_t utrim(size_t pad);
+int ureset();
+void ustats(struct ustats *out);
 
 
 // Portion that may not be edited
 int uinit();
 void *umalloc(size_t size);
-void ufree(void *ptr);
\ No newline at end of file
+void ufree(void *ptr);